@@ -0,0 +1,191 @@
+/******************************************************************************
+ * Accounting of the CPU-time and wall-time for each stage of a Parallel
+ * Pipeline, to tell whether a slow stage is computing or waiting.
+ *
+ * The Timer in common.hpp only measures the wall-time of the whole loop.
+ * When a stage is slow, it matters whether it is busy computing on the CPU,
+ * or waiting for I/O or a lock, or preempted because there are more busy
+ * threads than CPU cores. A computing stage may be split or farmed out to
+ * more threads, while a waiting stage needs its contention fixed, and a
+ * preempted stage needs fewer threads competing for the cores.
+ *
+ * Each call of a wrapped stage records its wall-time and the CPU-time of the
+ * thread, and optionally the number of voluntary and involuntary context
+ * switches of the thread. A voluntary context switch happens when the thread
+ * blocks, e.g. on I/O or a lock, and an involuntary context switch happens
+ * when the thread is preempted by the OS to run another thread.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef ACCOUNTING_HPP
+#define ACCOUNTING_HPP
+
+#include <sys/resource.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "trace.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Accumulated times and context switches for the calls of a stage. */
+struct StageAccount
+{
+    // Name of the stage.
+    string name;
+
+    // Number of calls.
+    long calls = 0;
+
+    // Wall-time and CPU-time in milli-sec.
+    double wall_ms = 0;
+    double cpu_ms = 0;
+
+    // Number of voluntary and involuntary context switches.
+    long voluntary = 0;
+    long involuntary = 0;
+
+    /**
+     * Why the stage is slow: "computing" if it mostly uses the CPU,
+     * "preempted" if it mostly waits after being preempted by the OS,
+     * and otherwise "waiting" e.g. for I/O or locks.
+     */
+    string verdict() const
+    {
+        if (cpu_ms >= 0.8 * wall_ms)
+        {
+            return "computing";
+        }
+        else if (involuntary > voluntary)
+        {
+            return "preempted";
+        }
+        else
+        {
+            return "waiting";
+        }
+    }
+
+    /** Description of the account for printing. */
+    string describe() const
+    {
+        double n = max(1L, calls);
+        return name + ": " + to_string(calls) + " calls" +
+               ", mean wall " + to_string(wall_ms / n) + "ms" +
+               ", mean CPU " + to_string(cpu_ms / n) + "ms" +
+               ", mean waiting " + to_string((wall_ms - cpu_ms) / n) + "ms" +
+               ", context switches " + to_string(voluntary) + " voluntary / " +
+               to_string(involuntary) + " involuntary" +
+               " -> " + verdict();
+    }
+};
+
+/*****************************************************************************/
+
+/**
+ * Accounting of the CPU-time and wall-time for the stages in a pipeline.
+ * Each account is only written by the thread running its stage, so there are
+ * no locks. The accounting must outlive the wrapped stages.
+ */
+class Accounting
+{
+    private:
+        // Account for each stage. These are pointers so they never move.
+        vector<unique_ptr<StageAccount>> accounts;
+
+        // Whether to count the context switches.
+        bool count_switches;
+
+        /** Context switches of the calling thread so far. */
+        static void thread_switches(long& voluntary, long& involuntary)
+        {
+            rusage usage;
+            getrusage(RUSAGE_THREAD, &usage);
+            voluntary = usage.ru_nvcsw;
+            involuntary = usage.ru_nivcsw;
+        }
+
+    public:
+        /**
+         * @param count_switches Whether to count the context switches, which
+         *                       costs two extra system calls per stage-call.
+         */
+        Accounting(bool count_switches = true) : count_switches(count_switches) {}
+
+        /**
+         * Wrap a processing stage so its calls are accounted. All stages must
+         * be wrapped before the pipeline starts.
+         *
+         * @param name Name of the stage.
+         * @param func Processing function of the stage.
+         * @return Processing function that accounts its calls.
+         */
+        template <typename T>
+        function<T(T const&)> wrap(string const& name, function<T(T const&)> func)
+        {
+            accounts.emplace_back(new StageAccount());
+            StageAccount* account = accounts.back().get();
+            account->name = name;
+            bool switches = count_switches;
+
+            return [account, func, switches](T const& x)
+            {
+                long vol_start = 0, invol_start = 0;
+                if (switches)
+                {
+                    thread_switches(vol_start, invol_start);
+                }
+
+                auto wall_start = chrono::steady_clock::now();
+                double cpu_start = thread_cpu_ms();
+
+                T y = func(x);
+
+                double cpu_end = thread_cpu_ms();
+                chrono::duration<double, milli> wall = chrono::steady_clock::now() - wall_start;
+
+                account->calls++;
+                account->wall_ms += wall.count();
+                account->cpu_ms += cpu_end - cpu_start;
+
+                if (switches)
+                {
+                    long vol_end = 0, invol_end = 0;
+                    thread_switches(vol_end, invol_end);
+                    account->voluntary += vol_end - vol_start;
+                    account->involuntary += invol_end - invol_start;
+                }
+
+                return y;
+            };
+        }
+
+        /** Report for all the stages. Must not be called while the pipeline runs. */
+        string describe() const
+        {
+            string desc;
+            for (auto const& account : accounts)
+            {
+                desc += account->describe() + "\n";
+            }
+            return desc;
+        }
+
+        /** Account of stage k. Must not be called while the pipeline runs. */
+        StageAccount const& get(size_t k) const
+        {
+            return *accounts[k];
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,257 @@
+/******************************************************************************
+ * Blocks of audio samples, which may be flagged as constant e.g. for digital
+ * silence, and processing stages that can map a constant input block to a
+ * constant output block without processing all of its samples.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef BLOCK_HPP
+#define BLOCK_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Block of audio samples. If the block is flagged as constant, then all its
+ * samples have the same value and the sample-vector is not used, so it can
+ * be processed in O(1) time by stages that know how to map a constant.
+ *
+ * A block with size 0 means there is no data, like no_data for strings.
+ */
+struct Block
+{
+    // Audio samples, which are not used if the block is constant.
+    vector<float> data;
+
+    // Number of samples in the block.
+    size_t size = 0;
+
+    // Whether all samples in the block have the same value.
+    bool is_constant = false;
+
+    // Value of all samples if the block is constant.
+    float value = 0.0f;
+
+    /** Sample with index i, regardless of whether the block is constant. */
+    float at(size_t i) const
+    {
+        return is_constant ? value : data[i];
+    }
+};
+
+/*****************************************************************************/
+
+/**
+ * Create a block from a vector of samples.
+ *
+ * @param data Audio samples.
+ * @return Block which is not flagged as constant.
+ */
+Block make_block(vector<float> data)
+{
+    Block block;
+    block.size = data.size();
+    block.data = move(data);
+    return block;
+}
+
+/**
+ * Create a constant block in O(1) time.
+ *
+ * @param size Number of samples in the block.
+ * @param value Value of all samples.
+ * @return Block which is flagged as constant.
+ */
+Block make_constant_block(size_t size, float value)
+{
+    Block block;
+    block.size = size;
+    block.is_constant = true;
+    block.value = value;
+    return block;
+}
+
+/**
+ * Check if all samples in the block have the same value, and if so then flag
+ * the block as constant and release its sample-vector. This takes O(n) time
+ * so it should only be done once at the source of the stream, after which
+ * the flag is propagated through the pipeline.
+ *
+ * @param block Block to be checked and possibly flagged as constant.
+ */
+void detect_constant(Block& block)
+{
+    if (block.is_constant || block.size == 0)
+    {
+        return;
+    }
+
+    for (size_t i=1; i<block.size; i++)
+    {
+        if (block.data[i] != block.data[0])
+        {
+            return;
+        }
+    }
+
+    block = make_constant_block(block.size, block.data[0]);
+}
+
+/** Whether the block is empty, which means it is a bubble in the pipeline. */
+bool is_no_data(Block const& block)
+{
+    return block.size == 0;
+}
+
+/**
+ * Short description of a block for printing.
+ *
+ * @param block Block to be described.
+ * @return string with the description.
+ */
+string to_string(Block const& block)
+{
+    if (is_no_data(block))
+    {
+        return no_data;
+    }
+
+    if (block.is_constant)
+    {
+        return "[const " + std::to_string(block.value) + "]";
+    }
+
+    return "[" + std::to_string(block.size) + " samples]";
+}
+
+/*****************************************************************************/
+
+/**
+ * Sum of two blocks of equal size. If both blocks are constant, then the sum
+ * is also constant and calculated in O(1) time. If only one block has data,
+ * then the other block is treated as silence.
+ *
+ * @param x First block.
+ * @param y Second block.
+ * @return Block with the sum.
+ */
+Block sum(Block const& x, Block const& y)
+{
+    // Propagate the bubble if one or both blocks are empty.
+    if (is_no_data(x))
+    {
+        return y;
+    }
+    if (is_no_data(y))
+    {
+        return x;
+    }
+
+    // Constant plus constant is constant.
+    if (x.is_constant && y.is_constant)
+    {
+        return make_constant_block(x.size, x.value + y.value);
+    }
+
+    vector<float> data(x.size);
+    for (size_t i=0; i<x.size; i++)
+    {
+        data[i] = x.at(i) + y.at(i);
+    }
+
+    return make_block(move(data));
+}
+
+/*****************************************************************************/
+
+/**
+ * Processing stage for blocks. The stage may optionally declare how it maps
+ * a constant input value to a constant output value, e.g. for a linear gain
+ * or any other function that is applied to each sample independently. Then a
+ * constant input block is processed in O(1) time, and the output block is
+ * also flagged as constant, so the flag flows to the next stages as well.
+ *
+ * Stages that do not declare a constant-map always process all the samples,
+ * and their output is not flagged as constant.
+ */
+class Stage
+{
+    private:
+        // Processing function for blocks with data.
+        function<Block(Block const&)> process;
+
+        // Optional map from a constant input value to a constant output value.
+        function<float(float)> constant_map;
+
+    public:
+        /**
+         * Create a processing stage.
+         *
+         * @param process Processing function for blocks with data.
+         * @param constant_map Optional map for constant blocks.
+         */
+        Stage(function<Block(Block const&)> process,
+              function<float(float)> constant_map = nullptr)
+            : process(process), constant_map(constant_map) {}
+
+        /**
+         * Process a block, using the constant-map if possible.
+         *
+         * @param x Input block.
+         * @return Output block.
+         */
+        Block operator()(Block const& x) const
+        {
+            // Short-circuit for constant blocks.
+            if (x.is_constant && constant_map)
+            {
+                return make_constant_block(x.size, constant_map(x.value));
+            }
+
+            return process(x);
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Create a stage that applies a function to each sample independently,
+ * which means that it also maps a constant block to a constant block.
+ * The processing of blocks with data simulates heavy processing.
+ *
+ * @param func Function applied to each sample.
+ * @return Stage with both the processing function and constant-map.
+ */
+Stage make_sample_stage(function<float(float)> func)
+{
+    auto process = [func](Block const& x)
+    {
+        // Simulate heavy processing.
+        this_thread::sleep_for(sleep_time);
+
+        vector<float> data(x.size);
+        for (size_t i=0; i<x.size; i++)
+        {
+            data[i] = func(x.at(i));
+        }
+
+        return make_block(move(data));
+    };
+
+    return Stage(process, func);
+}
+
+/*****************************************************************************/
+
+#endif
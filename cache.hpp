@@ -0,0 +1,269 @@
+/******************************************************************************
+ * Memoization cache for pure processing functions.
+ *
+ * A processing function is pure if its output only depends on its input,
+ * which is the case for the dummy functions F, G and H in common.hpp. When
+ * identical inputs occur many times in the stream (e.g. digital silence,
+ * repeated loops or static video frames), the output can be looked up in a
+ * cache instead of being calculated again.
+ *
+ * Each stage in the pipeline has its own cache, which is only used by the
+ * thread that is running that stage in the current iteration. So there are
+ * no locks in the cache. Only the hit/miss statistics are atomic, so they
+ * can be read from other threads while the pipeline is running.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Fast 64-bit hash of a string using the FNV-1a algorithm.
+ *
+ * @param x String to be hashed.
+ * @return 64-bit hash value.
+ */
+inline uint64_t hash_fnv1a(string const& x)
+{
+    // FNV-1a constants for 64-bit hashes.
+    uint64_t const offset_basis = 14695981039346656037ULL;
+    uint64_t const prime = 1099511628211ULL;
+
+    uint64_t hash = offset_basis;
+
+    // Mix each byte of the string into the hash.
+    for (unsigned char c : x)
+    {
+        hash ^= c;
+        hash *= prime;
+    }
+
+    return hash;
+}
+
+/*****************************************************************************/
+
+/**
+ * Wrapper for a pure processing function with a memoization cache of its
+ * results. The cache is bounded both in the number of entries and in the
+ * number of bytes used by the cached strings. When the cache is full, an
+ * entry is evicted using the CLOCK algorithm, which approximates LRU without
+ * having to reorder a list on every cache hit.
+ *
+ * This must only be called by one thread at a time, which is always the case
+ * for a stage in the Parallel Pipeline, because each stage is called exactly
+ * once per iteration and all threads are joined between iterations.
+ */
+class StageCache
+{
+    private:
+        // Cached input and output of the processing function.
+        struct Entry
+        {
+            // Whether this slot holds a cached result.
+            bool valid = false;
+
+            // Reference bit for the CLOCK eviction algorithm.
+            bool referenced = false;
+
+            // Hash of the input string.
+            uint64_t hash = 0;
+
+            // Input string, which is compared on lookup to handle collisions.
+            string input;
+
+            // Output string of the processing function.
+            string output;
+        };
+
+        // The pure processing function whose results are cached.
+        function<string(string const&)> func;
+
+        // Fixed number of slots for the cache entries.
+        vector<Entry> entries;
+
+        // Map from input hash to slot index.
+        unordered_map<uint64_t, size_t> index;
+
+        // Max number of bytes used by the input and output strings.
+        size_t max_bytes;
+
+        // Current number of bytes used by the input and output strings.
+        size_t num_bytes = 0;
+
+        // Position of the "clock hand" for the CLOCK eviction algorithm.
+        size_t hand = 0;
+
+        // Statistics that may be read from other threads.
+        atomic<uint64_t> num_hits{0};
+        atomic<uint64_t> num_misses{0};
+        atomic<uint64_t> num_evictions{0};
+
+        /** Remove the entry in the given slot from the cache. */
+        void evict(size_t slot)
+        {
+            Entry& entry = entries[slot];
+
+            if (entry.valid)
+            {
+                index.erase(entry.hash);
+                num_bytes -= entry.input.size() + entry.output.size();
+                entry = Entry();
+                num_evictions.fetch_add(1, memory_order_relaxed);
+            }
+        }
+
+        /**
+         * Find a slot for a new entry using the CLOCK algorithm. Entries that
+         * have been referenced since the clock hand last passed them are given
+         * a second chance, otherwise they are evicted.
+         *
+         * @return Index of a free slot.
+         */
+        size_t find_slot()
+        {
+            while (true)
+            {
+                size_t slot = hand;
+                hand = (hand + 1) % entries.size();
+
+                Entry& entry = entries[slot];
+
+                if (entry.valid && entry.referenced)
+                {
+                    // Second chance.
+                    entry.referenced = false;
+                }
+                else
+                {
+                    evict(slot);
+                    return slot;
+                }
+            }
+        }
+
+    public:
+        /**
+         * Create a cache for a pure processing function.
+         *
+         * @param func Pure processing function e.g. F, G or H.
+         * @param max_entries Max number of cached results.
+         * @param max_bytes Max number of bytes for cached inputs and outputs.
+         */
+        StageCache(function<string(string const&)> func,
+                   size_t max_entries, size_t max_bytes = 1 << 20)
+            : func(func), entries(max_entries > 0 ? max_entries : 1),
+              max_bytes(max_bytes)
+        {
+            index.reserve(entries.size());
+        }
+
+        /**
+         * Return the cached output of the processing function for the input
+         * x, or call the processing function and save its output in the cache.
+         *
+         * @param x Input string for the processing function.
+         * @return Output string of the processing function.
+         */
+        string operator()(string const& x)
+        {
+            uint64_t hash = hash_fnv1a(x);
+
+            // Lookup the input in the cache.
+            auto it = index.find(hash);
+
+            if (it != index.end())
+            {
+                Entry& entry = entries[it->second];
+
+                // Compare the full input to guard against hash collisions.
+                if (entry.input == x)
+                {
+                    entry.referenced = true;
+                    num_hits.fetch_add(1, memory_order_relaxed);
+                    return entry.output;
+                }
+
+                // Hash collision so remove the old entry.
+                evict(it->second);
+            }
+
+            num_misses.fetch_add(1, memory_order_relaxed);
+
+            // Call the processing function.
+            string y = func(x);
+
+            // Only cache results that fit within the byte-limit.
+            size_t size = x.size() + y.size();
+
+            if (size <= max_bytes)
+            {
+                // Evict entries until there is room for the new entry.
+                size_t slot = find_slot();
+                while (num_bytes + size > max_bytes)
+                {
+                    evict(find_slot());
+                }
+
+                // Save the new entry.
+                Entry& entry = entries[slot];
+                entry.valid = true;
+                entry.referenced = false;
+                entry.hash = hash;
+                entry.input = x;
+                entry.output = y;
+                index[hash] = slot;
+                num_bytes += size;
+            }
+
+            return y;
+        }
+
+        /** Number of calls where the output was found in the cache. */
+        uint64_t hits() const
+        {
+            return num_hits.load(memory_order_relaxed);
+        }
+
+        /** Number of calls where the processing function had to be called. */
+        uint64_t misses() const
+        {
+            return num_misses.load(memory_order_relaxed);
+        }
+
+        /** Number of entries that have been removed from the cache. */
+        uint64_t evictions() const
+        {
+            return num_evictions.load(memory_order_relaxed);
+        }
+
+        /**
+         * Summary of the cache statistics.
+         *
+         * @return string with the statistics.
+         */
+        string stats() const
+        {
+            return "Hits: " + to_string(hits()) +
+                   ", Misses: " + to_string(misses()) +
+                   ", Evictions: " + to_string(evictions());
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,320 @@
+/******************************************************************************
+ * Checkpoint and restore of the in-flight state of a Parallel Pipeline, so it
+ * can resume in the middle of a stream after a restart.
+ *
+ * A Parallel Pipeline holds several iterations of data in its buffers, such
+ * as F_buffer and G_buffer in main2.cpp, and some stages may also have their
+ * own state. Without a checkpoint, this is lost on a restart, and the
+ * pipeline must be filled from scratch with the bubbles this gives.
+ *
+ * A snapshot is consistent when it is taken at an iteration boundary, after
+ * all the stage threads are joined and before the next iteration starts, so
+ * none of the stages are running. The snapshot is just a copy of the buffers
+ * and stage states, and it is written to a compact binary file in another
+ * thread, so it is cheap enough to take every few seconds. The file is first
+ * written under a temporary name, synced to the disk and then renamed, so a
+ * crash while writing never leaves a broken checkpoint.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Processing stage with a state that must be saved in a checkpoint. */
+class StatefulStage
+{
+    public:
+        virtual ~StatefulStage() {}
+
+        /** Process an input item, which may update the state. */
+        virtual string operator()(string const& x) = 0;
+
+        /** Save the state to a string of bytes. */
+        virtual string save_state() const = 0;
+
+        /** Load the state from a string of bytes made by save_state(). */
+        virtual void load_state(string const& state) = 0;
+};
+
+/*****************************************************************************/
+
+/** Snapshot of a pipeline at an iteration boundary. */
+struct Checkpoint
+{
+    // Index of the next iteration to be run.
+    uint64_t iteration = 0;
+
+    // Buffered output of the stages, e.g. F_buffer and G_buffer.
+    vector<string> buffers;
+
+    // Saved state of the stateful stages.
+    vector<string> states;
+};
+
+// Magic number and version at the start of a checkpoint file.
+static uint32_t const checkpoint_magic = 0x4B435050;  // "PPCK"
+static uint32_t const checkpoint_version = 1;
+
+/**
+ * Sync a file or directory to the disk with fsync().
+ *
+ * @param path Path of the file or directory.
+ * @param flags Flags for opening it, e.g. O_RDONLY | O_DIRECTORY.
+ * @return Whether it was synced.
+ */
+bool fsync_path(string const& path, int flags)
+{
+    int fd = open(path.c_str(), flags);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/**
+ * Save a checkpoint to a binary file. It is written to a temporary file which
+ * is synced to the disk and then renamed, and the directory is then synced
+ * so the rename is also on the disk. The file at the path is therefore always
+ * a complete checkpoint, even after a crash of the whole system.
+ *
+ * @param checkpoint Checkpoint to be saved.
+ * @param path Path of the file.
+ */
+void save_checkpoint(Checkpoint const& checkpoint, string const& path)
+{
+    string tmp_path = path + ".tmp";
+
+    {
+        ofstream file(tmp_path, ios::binary);
+        if (!file)
+        {
+            throw runtime_error("Cannot write checkpoint file: " + tmp_path);
+        }
+
+        auto write_u32 = [&](uint32_t v) { file.write((char const*) &v, sizeof(v)); };
+        auto write_strings = [&](vector<string> const& strings)
+        {
+            write_u32(strings.size());
+            for (auto const& s : strings)
+            {
+                write_u32(s.size());
+                file.write(s.data(), s.size());
+            }
+        };
+
+        write_u32(checkpoint_magic);
+        write_u32(checkpoint_version);
+        file.write((char const*) &checkpoint.iteration, sizeof(checkpoint.iteration));
+        write_strings(checkpoint.buffers);
+        write_strings(checkpoint.states);
+
+        if (!file.flush())
+        {
+            throw runtime_error("Cannot write checkpoint file: " + tmp_path);
+        }
+    }
+
+    // The contents must be on the disk before the rename, or a crash could
+    // leave the new name with an empty or partial file.
+    if (!fsync_path(tmp_path, O_WRONLY))
+    {
+        throw runtime_error("Cannot sync checkpoint file: " + tmp_path);
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        throw runtime_error("Cannot rename checkpoint file: " + tmp_path);
+    }
+
+    size_t slash = path.rfind('/');
+    string dir = (slash == string::npos) ? "." : (slash == 0) ? "/" : path.substr(0, slash);
+    if (!fsync_path(dir, O_RDONLY | O_DIRECTORY))
+    {
+        throw runtime_error("Cannot sync directory of checkpoint file: " + path);
+    }
+}
+
+/**
+ * Load a checkpoint from a binary file.
+ *
+ * @param path Path of the file.
+ * @return Checkpoint.
+ */
+Checkpoint load_checkpoint(string const& path)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error("Cannot read checkpoint file: " + path);
+    }
+
+    // Size of the file, so the sizes in the file can be checked before
+    // anything is allocated, in case the file is truncated or corrupt.
+    file.seekg(0, ios::end);
+    uint64_t file_size = file.tellg();
+    file.seekg(0, ios::beg);
+
+    auto check_size = [&](uint64_t num_bytes)
+    {
+        if (!file || num_bytes > file_size - (uint64_t) file.tellg())
+        {
+            throw runtime_error("Checkpoint file is truncated or corrupt: " + path);
+        }
+    };
+
+    auto read_u32 = [&]()
+    {
+        check_size(sizeof(uint32_t));
+        uint32_t v = 0;
+        file.read((char*) &v, sizeof(v));
+        return v;
+    };
+    auto read_strings = [&]()
+    {
+        // Each string has at least its size in the file.
+        uint32_t num_strings = read_u32();
+        check_size((uint64_t) num_strings * sizeof(uint32_t));
+        vector<string> strings(num_strings);
+        for (auto& s : strings)
+        {
+            uint32_t size = read_u32();
+            check_size(size);
+            s.resize(size);
+            file.read(&s[0], s.size());
+        }
+        return strings;
+    };
+
+    if (read_u32() != checkpoint_magic || read_u32() != checkpoint_version)
+    {
+        throw runtime_error("Not a checkpoint file: " + path);
+    }
+
+    Checkpoint checkpoint;
+    check_size(sizeof(checkpoint.iteration));
+    file.read((char*) &checkpoint.iteration, sizeof(checkpoint.iteration));
+    checkpoint.buffers = read_strings();
+    checkpoint.states = read_strings();
+
+    if (!file)
+    {
+        throw runtime_error("Checkpoint file is truncated or corrupt: " + path);
+    }
+
+    return checkpoint;
+}
+
+/*****************************************************************************/
+
+/**
+ * Writer of periodic checkpoints, which is called at every iteration boundary
+ * but only saves a checkpoint when the interval has passed. The file is
+ * written in another thread, so the pipeline only waits for the copy of its
+ * buffers. If the previous file is still being written, the checkpoint is
+ * skipped until the next iteration boundary.
+ */
+class Checkpointer
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Path of the checkpoint file.
+        string path;
+
+        // Time between the checkpoints.
+        chrono::milliseconds interval;
+
+        // Time of the last checkpoint.
+        clock_type::time_point time_last;
+
+        // Writing of the last checkpoint.
+        future<void> writing;
+
+        // Number of checkpoints saved.
+        long num_saved = 0;
+
+    public:
+        /**
+         * @param path Path of the checkpoint file.
+         * @param interval Time between the checkpoints.
+         */
+        Checkpointer(string const& path, chrono::milliseconds interval)
+            : path(path), interval(interval), time_last(clock_type::now()) {}
+
+        /** Wait for the last checkpoint to be written. */
+        ~Checkpointer()
+        {
+            if (writing.valid())
+            {
+                writing.wait();
+            }
+        }
+
+        /**
+         * Whether a checkpoint is due, so the pipeline only needs to copy its
+         * buffers and stage states when it is.
+         */
+        bool due() const
+        {
+            bool busy = writing.valid() &&
+                        writing.wait_for(chrono::seconds(0)) != future_status::ready;
+            return !busy && clock_type::now() - time_last >= interval;
+        }
+
+        /**
+         * Save a checkpoint in another thread.
+         *
+         * @param checkpoint Snapshot at an iteration boundary.
+         */
+        void save(Checkpoint checkpoint)
+        {
+            wait();
+            time_last = clock_type::now();
+            num_saved++;
+            writing = async(launch::async, [this, checkpoint]
+            {
+                save_checkpoint(checkpoint, path);
+            });
+        }
+
+        /** Wait for the last checkpoint to be written, and rethrow its error. */
+        void wait()
+        {
+            if (writing.valid())
+            {
+                writing.get();
+            }
+        }
+
+        /** Number of checkpoints saved. */
+        long saved() const
+        {
+            return num_saved;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -6,9 +6,13 @@
  * Copyright 2022 by Magnus Erik Hvass Pedersen.
  *****************************************************************************/
 
+#ifndef COMMON_HPP
+#define COMMON_HPP
+
 #include <string>
 #include <thread>
 #include <chrono>
+#include <future>
 #include <vector>
 
 using namespace std;
@@ -53,12 +57,62 @@ string H(string const& x)
 /** Dummy processing function + */
 string sum(string const& x, string const& y)
 {
+    // If both inputs are empty then the output is also empty, so the empty
+    // slot is propagated through the pipeline as a bubble.
+    if (x == no_data && y == no_data)
+    {
+        return no_data;
+    }
+
     // This is assumed to be an almost free operation so there is no sleep.
     return x + " + " + y;
 }
 
 /*****************************************************************************/
 
+/**
+ * Whether the string is empty (no_data), which means it is a "bubble" in the
+ * pipeline. Other data-types may overload this function.
+ * 
+ * @param x String to be checked.
+ * @return Boolean whether the string is empty.
+ */
+bool is_no_data(string const& x)
+{
+    return x == no_data;
+}
+
+/**
+ * Async execution of a processing function on the input x, unless x is
+ * empty (no_data) in which case the function is not called at all and the
+ * empty input is returned immediately as the output.
+ * 
+ * Empty inputs are "bubbles" in the pipeline, which occur while it is being
+ * filled at the start of the stream and drained at the end of the stream.
+ * There is no reason to spend time and a thread on processing them.
+ * 
+ * @param func Processing function e.g. F, G or H.
+ * @param x Input data for the processing function.
+ * @return Future with the output data of the processing function.
+ */
+template <typename Function, typename T>
+future<T> async_stage(Function func, T const& x)
+{
+    // If the input is a bubble then skip the processing function.
+    if (is_no_data(x))
+    {
+        // Future which is already finished with empty output.
+        promise<T> bubble;
+        bubble.set_value(x);
+        return bubble.get_future();
+    }
+
+    // Async execution of the processing function.
+    return async(func, x);
+}
+
+/*****************************************************************************/
+
 /**
  * Generate a vector of strings, where each string consists of the given prefix
  * and a suffix for its index in the vector.
@@ -116,3 +170,5 @@ class Timer
 };
 
 /*****************************************************************************/
+
+#endif
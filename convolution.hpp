@@ -0,0 +1,414 @@
+/******************************************************************************
+ * Uniformly partitioned FFT convolution, which can be used as a heavy and
+ * realistic processing stage instead of the dummy functions that sleep.
+ *
+ * The impulse response of length L is split into P partitions of B samples
+ * each, where B is the block size. Each partition is transformed with an FFT
+ * of size 2B. For each input block, the spectrum of the last 2B input samples
+ * is saved in a delay-line, and the output spectrum is the sum of the spectra
+ * in the delay-line multiplied with the spectra of the partitions. This is
+ * known as the overlap-save method with a frequency-domain delay-line.
+ *
+ * The FFT is self-contained and has no external dependencies. The complex
+ * multiply-accumulate over the partitions takes most of the time for long
+ * impulse responses, so it uses SSE instructions when they are available.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef CONVOLUTION_HPP
+#define CONVOLUTION_HPP
+
+#include <cmath>
+#include <vector>
+#include <future>
+#include <stdexcept>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Complex vector with the real and imaginary parts stored in separate arrays,
+ * which is better suited for SIMD instructions than interleaved pairs.
+ */
+struct SplitComplex
+{
+    vector<float> re;
+    vector<float> im;
+
+    SplitComplex(size_t n = 0) : re(n, 0.0f), im(n, 0.0f) {}
+
+    size_t size() const
+    {
+        return re.size();
+    }
+};
+
+/*****************************************************************************/
+
+/**
+ * Radix-2 FFT of a fixed size, with pre-calculated twiddle-factors and
+ * bit-reversal permutation.
+ */
+class FFT
+{
+    private:
+        // Size of the FFT, which must be a power of 2.
+        size_t n;
+
+        // Bit-reversed index for each element.
+        vector<size_t> bit_reverse;
+
+        // Twiddle-factors exp(-2*pi*i*k/n) for k < n/2.
+        SplitComplex twiddle;
+
+    public:
+        /**
+         * Create an FFT of the given size.
+         *
+         * @param n Size of the FFT, which must be a power of 2.
+         */
+        FFT(size_t n) : n(n), bit_reverse(n), twiddle(n / 2)
+        {
+            if (n < 2 || (n & (n - 1)) != 0)
+            {
+                throw invalid_argument("FFT size must be a power of 2.");
+            }
+
+            size_t bits = 0;
+            while (((size_t) 1 << bits) < n)
+            {
+                bits++;
+            }
+
+            for (size_t i=0; i<n; i++)
+            {
+                size_t r = 0;
+                for (size_t b=0; b<bits; b++)
+                {
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                }
+                bit_reverse[i] = r;
+            }
+
+            for (size_t k=0; k<n/2; k++)
+            {
+                double angle = -2.0 * M_PI * k / n;
+                twiddle.re[k] = (float) cos(angle);
+                twiddle.im[k] = (float) sin(angle);
+            }
+        }
+
+        /** Size of the FFT. */
+        size_t size() const
+        {
+            return n;
+        }
+
+        /**
+         * In-place FFT or inverse FFT. The inverse is not scaled by 1/n.
+         *
+         * @param x Complex data of the same size as the FFT.
+         * @param inverse Whether to calculate the inverse FFT.
+         */
+        void transform(SplitComplex& x, bool inverse = false) const
+        {
+            // Reorder the data in bit-reversed order.
+            for (size_t i=0; i<n; i++)
+            {
+                size_t j = bit_reverse[i];
+                if (i < j)
+                {
+                    swap(x.re[i], x.re[j]);
+                    swap(x.im[i], x.im[j]);
+                }
+            }
+
+            // Butterflies for each stage of the FFT.
+            float sign = inverse ? -1.0f : 1.0f;
+            for (size_t len=2; len<=n; len*=2)
+            {
+                size_t half = len / 2;
+                size_t step = n / len;
+
+                for (size_t start=0; start<n; start+=len)
+                {
+                    for (size_t k=0; k<half; k++)
+                    {
+                        float w_re = twiddle.re[k * step];
+                        float w_im = sign * twiddle.im[k * step];
+
+                        size_t a = start + k;
+                        size_t b = a + half;
+
+                        float t_re = x.re[b] * w_re - x.im[b] * w_im;
+                        float t_im = x.re[b] * w_im + x.im[b] * w_re;
+
+                        x.re[b] = x.re[a] - t_re;
+                        x.im[b] = x.im[a] - t_im;
+                        x.re[a] += t_re;
+                        x.im[a] += t_im;
+                    }
+                }
+            }
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Complex multiply-accumulate of two spectra: acc += x * h.
+ * This is the inner loop of the partitioned convolution.
+ *
+ * @param acc Accumulated spectrum.
+ * @param x Spectrum of the input.
+ * @param h Spectrum of an impulse response partition.
+ */
+inline void complex_mac(SplitComplex& acc, SplitComplex const& x, SplitComplex const& h)
+{
+    size_t n = acc.size();
+    size_t i = 0;
+
+#if defined(__SSE__)
+    // Process 4 complex numbers at a time.
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 xr = _mm_loadu_ps(&x.re[i]);
+        __m128 xi = _mm_loadu_ps(&x.im[i]);
+        __m128 hr = _mm_loadu_ps(&h.re[i]);
+        __m128 hi = _mm_loadu_ps(&h.im[i]);
+
+        __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+
+        _mm_storeu_ps(&acc.re[i], _mm_add_ps(_mm_loadu_ps(&acc.re[i]), re));
+        _mm_storeu_ps(&acc.im[i], _mm_add_ps(_mm_loadu_ps(&acc.im[i]), im));
+    }
+#endif
+
+    // Remaining elements, or all elements if SSE is not available.
+    for (; i < n; i++)
+    {
+        acc.re[i] += x.re[i] * h.re[i] - x.im[i] * h.im[i];
+        acc.im[i] += x.re[i] * h.im[i] + x.im[i] * h.re[i];
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * Processing stage for uniformly partitioned FFT convolution of a stream of
+ * blocks with a long impulse response. The stage has state, so the blocks
+ * must be processed in order, and the stage must not be copied between calls
+ * e.g. by passing it to async() - use ref() instead.
+ *
+ * The partitions are split into a head with only the first partition, and a
+ * tail with all the other partitions. The tail only uses the spectra of
+ * previous input blocks, so it can be calculated in advance in other threads
+ * while the rest of the pipeline is running. This pipelines the partitions
+ * across cores as sub-stages without adding any latency.
+ */
+class ConvolutionStage
+{
+    private:
+        // Number of samples in each block and each partition.
+        size_t block_size;
+
+        // FFT of size 2 * block_size.
+        FFT fft;
+
+        // Spectra of the impulse response partitions.
+        vector<SplitComplex> partitions;
+
+        // Frequency-domain delay-line with spectra of previous input, where
+        // delay_line[(head + j) % P] is the spectrum from j blocks ago.
+        vector<SplitComplex> delay_line;
+        size_t head = 0;
+
+        // Previous input block for the overlap-save method.
+        vector<float> prev_input;
+
+        // Number of threads for calculating the tail of the convolution.
+        size_t num_tail_threads;
+
+        // Tail of the output spectrum for the next block, being calculated.
+        vector<future<SplitComplex>> tail_futures;
+
+        /**
+         * Sum of the partitions with index in [begin, end) multiplied with the
+         * delay-line, where the delay-line is shifted by one block because it
+         * is calculated in advance for the next input block.
+         */
+        SplitComplex tail_sum(size_t begin, size_t end) const
+        {
+            SplitComplex acc(fft.size());
+
+            for (size_t j=begin; j<end; j++)
+            {
+                // Spectrum from j-1 blocks ago, which is j blocks ago for the
+                // next input block.
+                auto const& x = delay_line[(head + j - 1) % partitions.size()];
+                complex_mac(acc, x, partitions[j]);
+            }
+
+            return acc;
+        }
+
+        /** Start calculating the tail for the next input block. */
+        void start_tail()
+        {
+            size_t P = partitions.size();
+            size_t num_tail = P - 1;
+            size_t num_threads = min(num_tail_threads, num_tail);
+
+            for (size_t t=0; t<num_threads; t++)
+            {
+                size_t begin = 1 + t * num_tail / num_threads;
+                size_t end = 1 + (t + 1) * num_tail / num_threads;
+
+                tail_futures.push_back(async(launch::async,
+                    &ConvolutionStage::tail_sum, this, begin, end));
+            }
+        }
+
+    public:
+        /**
+         * Create a convolution stage.
+         *
+         * @param impulse_response Impulse response of any length.
+         * @param block_size Block size, which must be a power of 2.
+         * @param num_tail_threads Threads for calculating the tail in advance.
+         *                         If 0 then everything is calculated in the
+         *                         calling thread.
+         */
+        ConvolutionStage(vector<float> const& impulse_response,
+                         size_t block_size, size_t num_tail_threads = 0)
+            : block_size(block_size), fft(2 * block_size),
+              prev_input(block_size, 0.0f), num_tail_threads(num_tail_threads)
+        {
+            size_t P = max((size_t) 1, (impulse_response.size() + block_size - 1) / block_size);
+
+            // Transform each partition of the impulse response, zero-padded
+            // to the FFT size.
+            for (size_t p=0; p<P; p++)
+            {
+                SplitComplex h(fft.size());
+                for (size_t i=0; i<block_size; i++)
+                {
+                    size_t j = p * block_size + i;
+                    if (j < impulse_response.size())
+                    {
+                        h.re[i] = impulse_response[j];
+                    }
+                }
+                fft.transform(h);
+                partitions.push_back(h);
+            }
+
+            delay_line.assign(P, SplitComplex(fft.size()));
+        }
+
+        /** Moving is not allowed while tail-threads may refer to this object. */
+        ConvolutionStage(ConvolutionStage const&) = delete;
+        ConvolutionStage& operator=(ConvolutionStage const&) = delete;
+
+        /** Wait for the tail-threads to finish. */
+        ~ConvolutionStage()
+        {
+            for (auto& f : tail_futures)
+            {
+                f.wait();
+            }
+        }
+
+        /** Number of partitions of the impulse response. */
+        size_t num_partitions() const
+        {
+            return partitions.size();
+        }
+
+        /**
+         * Convolve the next block of the input stream.
+         *
+         * @param x Input block with block_size samples.
+         * @return Output block with block_size samples.
+         */
+        Block operator()(Block const& x)
+        {
+            if (x.size != block_size)
+            {
+                throw invalid_argument("ConvolutionStage got wrong block size.");
+            }
+
+            size_t P = partitions.size();
+            size_t N = fft.size();
+
+            // Spectrum of the previous and current input block.
+            SplitComplex X(N);
+            for (size_t i=0; i<block_size; i++)
+            {
+                X.re[i] = prev_input[i];
+                X.re[block_size + i] = prev_input[i] = x.at(i);
+            }
+            fft.transform(X);
+
+            // Output spectrum, which starts with the tail if it was calculated
+            // in advance, or else the tail is calculated here.
+            SplitComplex Y(N);
+            if (num_tail_threads > 0)
+            {
+                for (auto& f : tail_futures)
+                {
+                    SplitComplex tail = f.get();
+                    for (size_t i=0; i<N; i++)
+                    {
+                        Y.re[i] += tail.re[i];
+                        Y.im[i] += tail.im[i];
+                    }
+                }
+                tail_futures.clear();
+            }
+            else if (P > 1)
+            {
+                Y = tail_sum(1, P);
+            }
+
+            // Insert the new spectrum in the delay-line.
+            head = (head + P - 1) % P;
+            delay_line[head] = X;
+
+            // Head of the convolution with the first partition.
+            complex_mac(Y, X, partitions[0]);
+
+            // Start calculating the tail for the next block in other threads.
+            if (num_tail_threads > 0 && P > 1)
+            {
+                start_tail();
+            }
+
+            // Inverse FFT and keep the last half, which is valid output for
+            // the overlap-save method.
+            fft.transform(Y, true);
+
+            vector<float> y(block_size);
+            for (size_t i=0; i<block_size; i++)
+            {
+                y[i] = Y.re[block_size + i] / N;
+            }
+
+            return make_block(move(y));
+        }
+};
+
+/*****************************************************************************/
+
+#endif
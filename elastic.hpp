@@ -0,0 +1,469 @@
+/******************************************************************************
+ * Parallel Pipeline with an elastic number of active worker threads, which
+ * grows and shrinks with the measured load.
+ *
+ * In main1.cpp to main4.cpp, the number of threads is fixed by the number of
+ * processing functions. When the load is low, most of those threads are idle
+ * and each item is passed between threads for no reason. When the load is
+ * high, every stage needs its own thread to keep up with the input.
+ *
+ * Here the stages are connected by queues, and each active worker thread runs
+ * a group of consecutive stages. A controller measures the utilization and
+ * queue depth of each group at regular intervals. A busy group is split onto
+ * two workers, and two adjacent idle groups are merged onto one worker. The
+ * data is always in the queues between the stages, so the groups can be
+ * changed while the pipeline runs without losing or reordering items.
+ *
+ * To prevent thrashing between splitting and merging, the thresholds for the
+ * two decisions are far apart, a decision must be indicated for several
+ * intervals in a row, and nothing is changed for a while after a decision.
+ * All decisions are logged so they can be inspected afterwards.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef ELASTIC_HPP
+#define ELASTIC_HPP
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Settings for the elastic scaling. */
+struct ScalingPolicy
+{
+    // Time between the measurements of the load.
+    chrono::milliseconds interval{200};
+
+    // Split a group of stages if its utilization is above this.
+    double split_utilization = 0.9;
+
+    // Split a group of stages if its queues hold more items than this.
+    size_t split_queue_depth = 2;
+
+    // Merge two adjacent groups if their combined utilization is below this.
+    double merge_utilization = 0.7;
+
+    // Number of intervals in a row a decision must be indicated.
+    int patience = 2;
+
+    // Number of intervals after a decision where nothing is changed.
+    int cooldown = 2;
+};
+
+/** Logged decision of the elastic scaling. */
+struct ScalingDecision
+{
+    // Time in milli-sec since the start of the run.
+    double time_ms;
+
+    // Either "split" or "merge".
+    string action;
+
+    // Groups of stages after the decision, e.g. "[F G] [H]".
+    string groups;
+
+    // Utilization of the group(s) that caused the decision.
+    double utilization;
+
+    // Number of items in the queues of the group(s).
+    size_t queue_depth;
+};
+
+/*****************************************************************************/
+
+/**
+ * Parallel Pipeline for a chain of stages y = S_K(...S_1(x)) whose stages are
+ * merged and split onto a varying number of worker threads.
+ */
+class ElasticPipeline
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Item in a queue with its index in the input stream.
+        struct Item
+        {
+            size_t index;
+            string value;
+        };
+
+        // Processing stages and their names.
+        vector<function<string(string const&)>> stages;
+        vector<string> names;
+
+        // Settings for the scaling.
+        ScalingPolicy policy;
+
+        // Index of the first stage in each group. Group g is run by worker g.
+        vector<size_t> group_start;
+
+        // Input queue of each stage, whether it is being processed, and its
+        // busy time in the current interval. All protected by the lock.
+        vector<deque<Item>> queues;
+        vector<bool> busy;
+        vector<double> busy_ms;
+
+        // Output of the pipeline and the arrival time of each input item.
+        vector<string> y_vec;
+        vector<clock_type::time_point> arrival;
+        size_t num_finished = 0;
+
+        // Statistics.
+        double sum_latency_ms = 0;
+        double worker_ms = 0;
+        vector<ScalingDecision> log;
+
+        // Whether the workers should stop.
+        bool stop = false;
+
+        // Lock and signal for the queues and groups.
+        mutex state_mutex;
+        condition_variable state_cv;
+
+        /** First stage after group g. Must hold the lock. */
+        size_t group_end(size_t g) const
+        {
+            return (g + 1 < group_start.size()) ? group_start[g + 1] : stages.size();
+        }
+
+        /** Description of the groups, e.g. "[F G] [H]". Must hold the lock. */
+        string describe_groups() const
+        {
+            string desc;
+            for (size_t g=0; g<group_start.size(); g++)
+            {
+                desc += (g > 0) ? " [" : "[";
+                for (size_t k=group_start[g]; k<group_end(g); k++)
+                {
+                    desc += (k > group_start[g]) ? " " + names[k] : names[k];
+                }
+                desc += "]";
+            }
+            return desc;
+        }
+
+        /**
+         * Main loop for worker w, which runs the stages of group w. A worker
+         * without a group is inactive and sleeps.
+         */
+        void run_worker(size_t w)
+        {
+            unique_lock<mutex> lock(state_mutex);
+
+            while (!stop)
+            {
+                // Find the last stage of the group with an item in its queue,
+                // so the items further down the pipeline are finished first.
+                // A stage that was just moved from another group may still be
+                // busy, and each stage only processes one item at a time so
+                // the items stay in order.
+                size_t k_found = stages.size();
+                if (w < group_start.size())
+                {
+                    for (size_t k=group_end(w); k-- > group_start[w]; )
+                    {
+                        if (!queues[k].empty() && !busy[k])
+                        {
+                            k_found = k;
+                            break;
+                        }
+                    }
+                }
+
+                if (k_found == stages.size())
+                {
+                    state_cv.wait(lock);
+                    continue;
+                }
+
+                Item item = move(queues[k_found].front());
+                queues[k_found].pop_front();
+                busy[k_found] = true;
+
+                lock.unlock();
+                auto time_start = clock_type::now();
+                item.value = stages[k_found](item.value);
+                chrono::duration<double, milli> dur = clock_type::now() - time_start;
+                lock.lock();
+
+                busy[k_found] = false;
+                busy_ms[k_found] += dur.count();
+
+                if (k_found + 1 < stages.size())
+                {
+                    queues[k_found + 1].push_back(move(item));
+                }
+                else
+                {
+                    chrono::duration<double, milli> latency = clock_type::now() - arrival[item.index];
+                    sum_latency_ms += latency.count();
+                    y_vec[item.index] = move(item.value);
+                    num_finished++;
+                }
+
+                state_cv.notify_all();
+            }
+        }
+
+        /**
+         * Measure the load and decide whether to split or merge groups.
+         * Must hold the lock.
+         *
+         * @param interval_ms Length of the interval in milli-sec.
+         * @param time_ms Time since the start of the run.
+         * @param split_count Intervals in a row a split was indicated.
+         * @param merge_count Intervals in a row a merge was indicated.
+         * @param cooldown_left Intervals left of the cooldown after a decision.
+         */
+        void control(double interval_ms, double time_ms, int& split_count, int& merge_count,
+                     int& cooldown_left)
+        {
+            size_t num_groups = group_start.size();
+
+            // Utilization and queue depth of each group. The busy time is
+            // only added when a stage-call finishes, so it is capped at 1.
+            vector<double> util(num_groups);
+            vector<size_t> depth(num_groups);
+            for (size_t g=0; g<num_groups; g++)
+            {
+                double group_busy = 0;
+                depth[g] = 0;
+                for (size_t k=group_start[g]; k<group_end(g); k++)
+                {
+                    group_busy += busy_ms[k];
+                    depth[g] += queues[k].size();
+                }
+                util[g] = min(1.0, group_busy / interval_ms);
+            }
+
+            // Busiest group with more than one stage.
+            size_t g_split = num_groups;
+            for (size_t g=0; g<num_groups; g++)
+            {
+                bool overloaded = util[g] > policy.split_utilization ||
+                                  depth[g] > policy.split_queue_depth;
+                if (group_end(g) - group_start[g] > 1 && overloaded &&
+                    (g_split == num_groups || util[g] > util[g_split]))
+                {
+                    g_split = g;
+                }
+            }
+
+            // Adjacent groups with the lowest combined utilization.
+            size_t g_merge = num_groups;
+            for (size_t g=0; g+1<num_groups; g++)
+            {
+                double combined = util[g] + util[g + 1];
+                bool idle = combined < policy.merge_utilization &&
+                            depth[g] + depth[g + 1] <= 1;
+                if (idle && (g_merge == num_groups || combined < util[g_merge] + util[g_merge + 1]))
+                {
+                    g_merge = g;
+                }
+            }
+
+            // Nothing is changed during the cooldown, and the patience is
+            // counted again from the end of the cooldown.
+            if (cooldown_left > 0)
+            {
+                cooldown_left--;
+                split_count = 0;
+                merge_count = 0;
+                fill(busy_ms.begin(), busy_ms.end(), 0.0);
+                return;
+            }
+
+            split_count = (g_split < num_groups) ? split_count + 1 : 0;
+            merge_count = (g_split == num_groups && g_merge < num_groups) ? merge_count + 1 : 0;
+
+            if (split_count >= policy.patience)
+            {
+                // Split where the busy times of the two parts are most even.
+                size_t begin = group_start[g_split];
+                size_t end = group_end(g_split);
+                size_t best = begin + 1;
+                double best_max = INFINITY;
+                for (size_t s=begin+1; s<end; s++)
+                {
+                    double left = 0;
+                    double right = 0;
+                    for (size_t k=begin; k<end; k++)
+                    {
+                        ((k < s) ? left : right) += busy_ms[k];
+                    }
+                    if (max(left, right) < best_max)
+                    {
+                        best_max = max(left, right);
+                        best = s;
+                    }
+                }
+
+                group_start.insert(group_start.begin() + g_split + 1, best);
+                log.push_back({time_ms, "split", describe_groups(), util[g_split], depth[g_split]});
+            }
+            else if (merge_count >= policy.patience)
+            {
+                group_start.erase(group_start.begin() + g_merge + 1);
+                log.push_back({time_ms, "merge", describe_groups(),
+                               util[g_merge] + util[g_merge + 1], depth[g_merge] + depth[g_merge + 1]});
+            }
+
+            if (split_count >= policy.patience || merge_count >= policy.patience)
+            {
+                split_count = 0;
+                merge_count = 0;
+                cooldown_left = policy.cooldown;
+                state_cv.notify_all();
+            }
+
+            fill(busy_ms.begin(), busy_ms.end(), 0.0);
+        }
+
+    public:
+        /**
+         * Create an elastic pipeline, which starts with all stages merged
+         * onto a single worker thread.
+         *
+         * @param stages Processing stages in the order they are applied.
+         * @param names Names of the stages for the decision log.
+         * @param policy Settings for the scaling.
+         */
+        ElasticPipeline(vector<function<string(string const&)>> const& stages,
+                        vector<string> const& names, ScalingPolicy const& policy = {})
+            : stages(stages), names(names), policy(policy), group_start{0}
+        {
+            if (stages.empty() || names.size() != stages.size())
+            {
+                throw invalid_argument("ElasticPipeline needs a name for each stage.");
+            }
+        }
+
+        /**
+         * Process the input data, which arrives at the given times.
+         *
+         * @param x_vec Input data.
+         * @param arrival_ms Arrival time of each item in milli-sec from the start.
+         * @return Output data.
+         */
+        vector<string> run(vector<string> const& x_vec, vector<double> const& arrival_ms)
+        {
+            size_t K = stages.size();
+            size_t n = x_vec.size();
+            auto time_start = clock_type::now();
+
+            {
+                lock_guard<mutex> lock(state_mutex);
+                queues.assign(K, deque<Item>());
+                busy.assign(K, false);
+                busy_ms.assign(K, 0.0);
+                y_vec.assign(n, no_data);
+                arrival.assign(n, time_start);
+                num_finished = 0;
+                sum_latency_ms = 0;
+                worker_ms = 0;
+                log.clear();
+                stop = false;
+            }
+
+            // There is a thread for each stage, but only one per group is active.
+            vector<thread> workers;
+            for (size_t w=0; w<K; w++)
+            {
+                workers.emplace_back(&ElasticPipeline::run_worker, this, w);
+            }
+
+            // Feed the input items at their arrival times, and control the
+            // scaling between the arrivals.
+            int split_count = 0;
+            int merge_count = 0;
+            int cooldown_left = 0;
+            auto next_control = time_start + policy.interval;
+            size_t i = 0;
+
+            unique_lock<mutex> lock(state_mutex);
+            while (num_finished < n)
+            {
+                auto next_arrival = (i < n) ?
+                    time_start + chrono::duration_cast<clock_type::duration>(
+                        chrono::duration<double, milli>(arrival_ms[i])) :
+                    clock_type::time_point::max();
+
+                state_cv.wait_until(lock, min(next_arrival, next_control));
+                auto now = clock_type::now();
+
+                if (now >= next_arrival)
+                {
+                    arrival[i] = now;
+                    queues[0].push_back({i, x_vec[i]});
+                    i++;
+                    state_cv.notify_all();
+                }
+
+                if (now >= next_control)
+                {
+                    double interval_ms = chrono::duration<double, milli>(policy.interval).count();
+                    double time_ms = chrono::duration<double, milli>(now - time_start).count();
+                    worker_ms += interval_ms * group_start.size();
+                    control(interval_ms, time_ms, split_count, merge_count, cooldown_left);
+                    next_control += policy.interval;
+                }
+            }
+
+            stop = true;
+            state_cv.notify_all();
+            lock.unlock();
+
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+
+            return y_vec;
+        }
+
+        /** Log of the scaling decisions from the last run. */
+        vector<ScalingDecision> const& decisions() const
+        {
+            return log;
+        }
+
+        /** Metrics of the last run for printing, including the decision log. */
+        string describe() const
+        {
+            string desc;
+            for (auto const& d : log)
+            {
+                desc += to_string(d.time_ms) + "ms: " + d.action + " -> " + d.groups +
+                        " (utilization " + to_string(d.utilization) +
+                        ", queue depth " + to_string(d.queue_depth) + ")\n";
+            }
+
+            size_t n = max((size_t) 1, y_vec.size());
+            desc += "Mean latency: " + to_string(sum_latency_ms / n) + "ms" +
+                    ", Worker time: " + to_string(worker_ms) + "ms" +
+                    ", Decisions: " + to_string(log.size());
+            return desc;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
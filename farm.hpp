@@ -0,0 +1,211 @@
+/******************************************************************************
+ * Farming out a slow stage of a Parallel Pipeline to several worker threads,
+ * with links between the stages that either keep the order of the items or
+ * pass them on as soon as they are finished.
+ *
+ * When a stage is too slow to keep up with the rest of the pipeline, it can
+ * be replicated so several threads process different items at the same time.
+ * The items then finish out of order, and must normally be reordered so the
+ * next stage gets them in the same order as in the serial() functions of
+ * main1.cpp to main4.cpp. The reorder buffer holds back all the items that
+ * finish after a slow item, which adds to their latency.
+ *
+ * Some sinks do not need the order, e.g. aggregations or writing each item
+ * to its own file. The link to such a sink can be relaxed, so each item is
+ * passed on as soon as it is finished, tagged with its index in the stream.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef FARM_HPP
+#define FARM_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Item tagged with its index in the input stream. */
+struct Tagged
+{
+    size_t index;
+    string value;
+};
+
+/** Order of the items passed through a link. */
+enum class LinkOrder { InOrder, Relaxed };
+
+/**
+ * Link between two stages, which may have several producer and consumer
+ * threads. An in-order link holds back the items until all the items with
+ * lower index have been passed on, while a relaxed link passes on the items
+ * in the order they are pushed.
+ */
+class Link
+{
+    private:
+        // Order of the items.
+        LinkOrder order;
+
+        // Items that can be popped.
+        deque<Tagged> ready;
+
+        // Reorder buffer with the items that are held back, and the index of
+        // the next item that can be passed on. Only used by in-order links.
+        map<size_t, string> held;
+        size_t next_index = 0;
+
+        // Max number of items in the reorder buffer.
+        size_t max_held = 0;
+
+        // Whether all the producers are finished.
+        bool closed = false;
+
+        // Lock and signal for the items.
+        mutex link_mutex;
+        condition_variable link_cv;
+
+    public:
+        /**
+         * @param order Order of the items passed through the link.
+         */
+        Link(LinkOrder order) : order(order) {}
+
+        /**
+         * Push an item to the link. This may be called by several threads.
+         *
+         * @param item Item tagged with its index in the stream.
+         */
+        void push(Tagged item)
+        {
+            {
+                lock_guard<mutex> lock(link_mutex);
+
+                if (order == LinkOrder::Relaxed)
+                {
+                    ready.push_back(move(item));
+                }
+                else
+                {
+                    held[item.index] = move(item.value);
+
+                    // Pass on the items that are now in order.
+                    auto it = held.begin();
+                    while (it != held.end() && it->first == next_index)
+                    {
+                        ready.push_back({next_index++, move(it->second)});
+                        it = held.erase(it);
+                    }
+
+                    max_held = max(max_held, held.size());
+                }
+            }
+            link_cv.notify_all();
+        }
+
+        /**
+         * Pop an item from the link, and wait until one is available.
+         *
+         * @param item Popped item.
+         * @return False if the link is closed and there are no more items.
+         */
+        bool pop(Tagged& item)
+        {
+            unique_lock<mutex> lock(link_mutex);
+            link_cv.wait(lock, [this] { return !ready.empty() || closed; });
+
+            if (ready.empty())
+            {
+                return false;
+            }
+
+            item = move(ready.front());
+            ready.pop_front();
+            return true;
+        }
+
+        /** Close the link when all the producers are finished. */
+        void close()
+        {
+            {
+                lock_guard<mutex> lock(link_mutex);
+                closed = true;
+            }
+            link_cv.notify_all();
+        }
+
+        /** Max number of items that were held back by the reorder buffer. */
+        size_t max_buffered()
+        {
+            lock_guard<mutex> lock(link_mutex);
+            return max_held;
+        }
+};
+
+/*****************************************************************************/
+
+/** Stage which is farmed out to several worker threads. */
+class Farm
+{
+    private:
+        // Processing function.
+        function<string(string const&)> func;
+
+        // Number of worker threads.
+        size_t replicas;
+
+    public:
+        /**
+         * @param func Processing function, which must be thread-safe.
+         * @param replicas Number of worker threads.
+         */
+        Farm(function<string(string const&)> func, size_t replicas)
+            : func(func), replicas(replicas) {}
+
+        /**
+         * Process all the items from the input link, and push the results to
+         * the output link with the same index. This returns when the input
+         * link is closed and all items are processed, and then closes the
+         * output link.
+         *
+         * @param in Input link.
+         * @param out Output link.
+         */
+        void run(Link& in, Link& out)
+        {
+            vector<thread> workers;
+            for (size_t r=0; r<replicas; r++)
+            {
+                workers.emplace_back([this, &in, &out]
+                {
+                    Tagged item;
+                    while (in.pop(item))
+                    {
+                        out.push({item.index, func(item.value)});
+                    }
+                });
+            }
+
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+
+            out.close();
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,386 @@
+/******************************************************************************
+ * Frames of 2D images, e.g. from a camera, and a Parallel Pipeline that runs
+ * its stages on stripes of rows instead of whole frames.
+ *
+ * If whole frames are pushed through the pipeline in lockstep, like the items
+ * in main2.cpp, then each stage adds a whole frame of latency, and a large
+ * frame is evicted from the CPU caches before the next stage processes it.
+ *
+ * Here each frame is split into stripes of rows, and the stages run in
+ * lockstep on the stripes instead. Each stage then only adds the latency of
+ * one stripe, and a stripe is still in the cache when the next stage reads it.
+ *
+ * Filters such as blur and sharpen also need the rows just above and below
+ * each output row. A stage declares this radius, and it is then delayed by
+ * enough iterations that the previous stage has finished the stripe below.
+ * The stages read and write different stripes of the same frame-buffers in
+ * each iteration, so nothing is copied between the stages.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <array>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Frame of an RGB image with float pixels, stored row by row. */
+struct Frame
+{
+    // Size of the frame in pixels.
+    size_t width = 0;
+    size_t height = 0;
+
+    // Pixels with 3 channels each.
+    vector<float> pixels;
+
+    /** Pointer to the first pixel of row y, clamped to the frame. */
+    float const* row(long y) const
+    {
+        y = max(0L, min((long) height - 1, y));
+        return pixels.data() + y * width * 3;
+    }
+
+    float* row(long y)
+    {
+        y = max(0L, min((long) height - 1, y));
+        return pixels.data() + y * width * 3;
+    }
+};
+
+/** Create a black frame. */
+Frame make_frame(size_t width, size_t height)
+{
+    Frame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.pixels.assign(width * height * 3, 0.0f);
+    return frame;
+}
+
+/*****************************************************************************/
+
+/** Processing stage for a range of rows in a frame. */
+struct FrameStage
+{
+    // Name of the stage.
+    string name;
+
+    // Number of rows above and below each output row that the stage reads.
+    size_t radius;
+
+    // Process the rows [row_begin, row_end) of the input to the output.
+    function<void(Frame const& in, Frame& out, size_t row_begin, size_t row_end)> process;
+};
+
+/**
+ * Stage that applies a 3x3 convolution kernel to each channel, where the
+ * pixels outside the frame are clamped to the border.
+ *
+ * @param name Name of the stage.
+ * @param kernel Weights of the 3x3 kernel in row-major order.
+ * @return Stage with radius 1.
+ */
+FrameStage kernel_stage(string const& name, array<float, 9> kernel)
+{
+    auto process = [kernel](Frame const& in, Frame& out, size_t row_begin, size_t row_end)
+    {
+        long w = in.width;
+        for (size_t y=row_begin; y<row_end; y++)
+        {
+            float const* rows[3] = {in.row(y - 1), in.row(y), in.row(y + 1)};
+            float* dst = out.row(y);
+
+            for (long x=0; x<w; x++)
+            {
+                long xs[3] = {max(0L, x - 1), x, min(w - 1, x + 1)};
+                for (int c=0; c<3; c++)
+                {
+                    float v = 0.0f;
+                    for (int i=0; i<3; i++)
+                    {
+                        for (int j=0; j<3; j++)
+                        {
+                            v += kernel[i * 3 + j] * rows[i][xs[j] * 3 + c];
+                        }
+                    }
+                    dst[x * 3 + c] = v;
+                }
+            }
+        }
+    };
+
+    return {name, 1, process};
+}
+
+/** Stage that blurs the frame with a 3x3 box filter. */
+FrameStage blur_stage()
+{
+    float w = 1.0f / 9.0f;
+    return kernel_stage("blur", {w, w, w, w, w, w, w, w, w});
+}
+
+/** Stage that sharpens the frame with a 3x3 filter. */
+FrameStage sharpen_stage()
+{
+    return kernel_stage("sharpen", {0, -1, 0, -1, 5, -1, 0, -1, 0});
+}
+
+/**
+ * Stage that transforms the colour of each pixel with a 3x3 matrix, e.g. for
+ * colour grading. It only reads the pixel itself, so its radius is 0.
+ */
+FrameStage color_stage(array<float, 9> matrix)
+{
+    auto process = [matrix](Frame const& in, Frame& out, size_t row_begin, size_t row_end)
+    {
+        for (size_t y=row_begin; y<row_end; y++)
+        {
+            float const* src = in.row(y);
+            float* dst = out.row(y);
+
+            for (size_t x=0; x<in.width; x++)
+            {
+                float const* p = src + x * 3;
+                for (int c=0; c<3; c++)
+                {
+                    dst[x * 3 + c] = matrix[c * 3] * p[0] + matrix[c * 3 + 1] * p[1] +
+                                     matrix[c * 3 + 2] * p[2];
+                }
+            }
+        }
+    };
+
+    return {"color", 0, process};
+}
+
+/*****************************************************************************/
+
+/**
+ * Chain of frame stages, which can be run serially, pipelined over whole
+ * frames, or pipelined over stripes of rows. Each executor returns the output
+ * frames, and measures the mean latency from the start of processing a frame
+ * until its last row is output.
+ */
+class FramePipeline
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Processing stages.
+        vector<FrameStage> stages;
+
+        // Number of rows in a stripe.
+        size_t stripe_rows;
+
+        // Mean latency in milli-sec from the last run.
+        double latency_ms = 0;
+
+        /** Run stage k on the whole frame. */
+        Frame run_stage(size_t k, Frame const& in) const
+        {
+            Frame out = make_frame(in.width, in.height);
+            stages[k].process(in, out, 0, in.height);
+            return out;
+        }
+
+    public:
+        /**
+         * @param stages Processing stages in the order they are applied.
+         * @param stripe_rows Number of rows in a stripe.
+         */
+        FramePipeline(vector<FrameStage> const& stages, size_t stripe_rows)
+            : stages(stages), stripe_rows(stripe_rows) {}
+
+        /** Serial processing of whole frames, like serial() in main2.cpp. */
+        vector<Frame> serial(vector<Frame> const& frames)
+        {
+            vector<Frame> outputs;
+            double sum_latency = 0;
+
+            for (auto const& frame : frames)
+            {
+                auto time_start = clock_type::now();
+                Frame y = frame;
+                for (size_t k=0; k<stages.size(); k++)
+                {
+                    y = run_stage(k, y);
+                }
+                outputs.push_back(move(y));
+                sum_latency += chrono::duration<double, milli>(clock_type::now() - time_start).count();
+            }
+
+            latency_ms = sum_latency / frames.size();
+            return outputs;
+        }
+
+        /**
+         * Parallel processing of whole frames, where each stage runs in its
+         * own thread on the buffered output of the previous stage, like
+         * parallel() in main2.cpp.
+         */
+        vector<Frame> parallel_frames(vector<Frame> const& frames)
+        {
+            size_t K = stages.size();
+            size_t n = frames.size();
+            vector<Frame> buffers(K);
+            vector<Frame> outputs;
+            vector<clock_type::time_point> start(n);
+            double sum_latency = 0;
+
+            for (size_t i=0; i<n + K - 1; i++)
+            {
+                if (i < n)
+                {
+                    start[i] = clock_type::now();
+                }
+
+                vector<future<Frame>> futures;
+                for (size_t k=0; k<K; k++)
+                {
+                    // Bubbles while filling and draining the pipeline.
+                    if (i < k || i - k >= n)
+                    {
+                        futures.push_back(async(launch::deferred, [] { return Frame(); }));
+                        continue;
+                    }
+
+                    Frame const& in = (k == 0) ? frames[i] : buffers[k - 1];
+                    futures.push_back(async(launch::async, [this, k, &in] { return run_stage(k, in); }));
+                }
+
+                // All the stages must finish before the buffers are replaced,
+                // because stage k+1 reads the buffer of stage k.
+                vector<Frame> results;
+                for (auto& future : futures)
+                {
+                    results.push_back(future.get());
+                }
+                buffers = move(results);
+
+                if (i >= K - 1)
+                {
+                    outputs.push_back(buffers[K - 1]);
+                    sum_latency += chrono::duration<double, milli>(
+                        clock_type::now() - start[i - (K - 1)]).count();
+                }
+            }
+
+            latency_ms = sum_latency / n;
+            return outputs;
+        }
+
+        /**
+         * Parallel processing of stripes of rows, where each stage runs in
+         * its own thread on a stripe that the previous stages have finished.
+         * The stripes of all the frames form one continuous stream.
+         */
+        vector<Frame> parallel_stripes(vector<Frame> const& frames)
+        {
+            size_t K = stages.size();
+            size_t n = frames.size();
+
+            if (n == 0)
+            {
+                return {};
+            }
+
+            size_t height = frames[0].height;
+            size_t S = (height + stripe_rows - 1) / stripe_rows;
+
+            // Delay of each stage in iterations. A stage must wait until the
+            // previous stage has finished the stripes within its radius.
+            vector<size_t> delay(K);
+            for (size_t k=0; k<K; k++)
+            {
+                size_t halo = (stages[k].radius + stripe_rows - 1) / stripe_rows;
+                delay[k] = (k == 0) ? 0 : delay[k - 1] + 1 + halo;
+
+                // The previous stage overwrites its buffer with the next frame,
+                // so its stripes must not wrap around into the halo.
+                if (k > 0 && S <= 2 * halo + 1)
+                {
+                    throw invalid_argument("Too few stripes for the radius of stage " + stages[k].name);
+                }
+            }
+
+            // Output frame-buffer of each stage. The last stage writes to the
+            // output frames instead.
+            vector<Frame> buffers(K, make_frame(frames[0].width, height));
+            vector<Frame> outputs(n, make_frame(frames[0].width, height));
+
+            vector<clock_type::time_point> start(n);
+            double sum_latency = 0;
+
+            size_t num_stripes = n * S;
+            for (size_t i=0; i<num_stripes + delay[K - 1]; i++)
+            {
+                if (i < num_stripes && i % S == 0)
+                {
+                    start[i / S] = clock_type::now();
+                }
+
+                vector<future<void>> futures;
+                for (size_t k=0; k<K; k++)
+                {
+                    // Skip the bubbles while filling and draining the pipeline.
+                    if (i < delay[k] || i - delay[k] >= num_stripes)
+                    {
+                        continue;
+                    }
+
+                    size_t g = i - delay[k];
+                    size_t f = g / S;
+                    size_t row_begin = (g % S) * stripe_rows;
+                    size_t row_end = min(height, row_begin + stripe_rows);
+
+                    Frame const& in = (k == 0) ? frames[f] : buffers[k - 1];
+                    Frame& out = (k == K - 1) ? outputs[f] : buffers[k];
+
+                    futures.push_back(async(launch::async, [this, k, &in, &out, row_begin, row_end]
+                    {
+                        stages[k].process(in, out, row_begin, row_end);
+                    }));
+                }
+
+                for (auto& future : futures)
+                {
+                    future.get();
+                }
+
+                // The last stripe of a frame has been output.
+                if (i >= delay[K - 1] && (i - delay[K - 1]) % S == S - 1)
+                {
+                    size_t f = (i - delay[K - 1]) / S;
+                    sum_latency += chrono::duration<double, milli>(clock_type::now() - start[f]).count();
+                }
+            }
+
+            latency_ms = sum_latency / n;
+            return outputs;
+        }
+
+        /** Mean latency in milli-sec per frame from the last run. */
+        double latency() const
+        {
+            return latency_ms;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,258 @@
+/******************************************************************************
+ * Cache-blocked fused serial executor for a chain of stages on large blocks,
+ * which is used instead of the Parallel Pipeline when only one CPU core is
+ * available, or when the pipeline would not be faster.
+ *
+ * The serial() functions in main1.cpp and main2.cpp run y = H(G(F(x))) by
+ * applying each stage to the whole block before the next stage starts. When
+ * the blocks are larger than the CPU caches, each stage must read its whole
+ * input block back from main memory, because the start of the block has been
+ * evicted from the cache by the time the previous stage reached the end.
+ *
+ * The fused executor instead runs the whole chain of stages on one small
+ * tile of the block at a time, so the tile stays in the L1 cache while all
+ * the stages process it. This only works for stages that process each tile
+ * independently, e.g. stages that apply a function to each sample.
+ *
+ * Running the stages in parallel threads only pays when a block takes much
+ * longer to process than it takes to start and join the threads, so for
+ * small blocks or a single core the fused serial executor is faster.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef FUSED_HPP
+#define FUSED_HPP
+
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include "common.hpp"
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Kernel of a stage which processes a tile of samples in-place, independently
+ * of the other tiles in the block.
+ */
+using TileKernel = function<void(float* data, size_t n)>;
+
+// Number of samples in a tile, so the tile and the stack of the stages fit
+// well within a 32 KB L1 data cache.
+static size_t const default_tile_size = 2048;
+
+/*****************************************************************************/
+
+/** Chain of stages which can be run naively, fused or pipelined. */
+class StageChain
+{
+    private:
+        // Kernels of the stages in the order they are applied.
+        vector<TileKernel> kernels;
+
+        // Number of samples in a tile for the fused executor.
+        size_t tile_size;
+
+        // Description of the last choice of executor.
+        string choice;
+
+        /** Copy of the samples in a block, which are then processed in-place. */
+        static vector<float> copy_data(Block const& x)
+        {
+            return x.is_constant ? vector<float>(x.size, x.value) : x.data;
+        }
+
+    public:
+        /**
+         * @param kernels Kernels of the stages in the order they are applied.
+         * @param tile_size Number of samples in a tile.
+         */
+        StageChain(vector<TileKernel> const& kernels, size_t tile_size = default_tile_size)
+            : kernels(kernels), tile_size(tile_size)
+        {
+            if (kernels.empty())
+            {
+                throw invalid_argument("StageChain needs a stage.");
+            }
+        }
+
+        /** Number of stages. */
+        size_t size() const
+        {
+            return kernels.size();
+        }
+
+        /**
+         * Run stage k on a whole block, like one function in serial().
+         *
+         * @param k Index of the stage.
+         * @param x Input block.
+         * @return Output block.
+         */
+        Block run_stage(size_t k, Block const& x) const
+        {
+            vector<float> data = copy_data(x);
+            kernels[k](data.data(), data.size());
+            return make_block(move(data));
+        }
+
+        /**
+         * Naive serial executor, which runs each stage on the whole block
+         * before the next stage, like serial() in main2.cpp. The block is
+         * copied once and then processed in-place, like in run_fused(), so
+         * the only difference is the cache blocking.
+         */
+        Block run_naive(Block const& x) const
+        {
+            vector<float> data = copy_data(x);
+            for (auto const& kernel : kernels)
+            {
+                kernel(data.data(), data.size());
+            }
+            return make_block(move(data));
+        }
+
+        /** Fused serial executor, which runs all the stages tile by tile. */
+        Block run_fused(Block const& x) const
+        {
+            vector<float> data = copy_data(x);
+
+            for (size_t begin=0; begin<data.size(); begin+=tile_size)
+            {
+                size_t n = min(tile_size, data.size() - begin);
+                for (auto const& kernel : kernels)
+                {
+                    kernel(data.data() + begin, n);
+                }
+            }
+
+            return make_block(move(data));
+        }
+
+        /**
+         * Parallel Pipeline where each stage runs in its own thread on the
+         * buffered output of the previous stage, like parallel() in main2.cpp.
+         *
+         * @param x_vec Input blocks.
+         * @param begin Index of the first input block to process.
+         * @return Output blocks for the input blocks from begin.
+         */
+        vector<Block> run_pipelined(vector<Block> const& x_vec, size_t begin = 0) const
+        {
+            size_t K = kernels.size();
+            size_t n = x_vec.size() - begin;
+            vector<Block> buffers(K);
+            vector<Block> y_vec;
+
+            for (size_t i=0; i<n + K - 1; i++)
+            {
+                vector<future<Block>> futures;
+                for (size_t k=0; k<K; k++)
+                {
+                    Block const& in = (k == 0) ? ((i < n) ? x_vec[begin + i] : Block()) : buffers[k - 1];
+                    futures.push_back(async_stage([this, k](Block const& b) { return run_stage(k, b); }, in));
+                }
+
+                for (size_t k=0; k<K; k++)
+                {
+                    buffers[k] = futures[k].get();
+                }
+
+                if (i >= K - 1)
+                {
+                    y_vec.push_back(buffers[K - 1]);
+                }
+            }
+
+            return y_vec;
+        }
+
+        /**
+         * Process a stream of blocks with the fastest executor. The fused
+         * serial executor is used if there is only one CPU core, or if the
+         * estimated time per block for the pipeline is not clearly lower. The
+         * estimate uses the measured time of the fused executor on the first
+         * block, and the measured overhead of starting and joining a thread.
+         *
+         * @param x_vec Input blocks.
+         * @param num_cores Number of CPU cores, or 0 to detect it.
+         * @return Output blocks.
+         */
+        vector<Block> process(vector<Block> const& x_vec, size_t num_cores = 0)
+        {
+            size_t K = kernels.size();
+            num_cores = (num_cores > 0) ? num_cores : thread::hardware_concurrency();
+
+            if (x_vec.empty())
+            {
+                return {};
+            }
+
+            // Measure the fused executor on the first block.
+            auto time_start = chrono::steady_clock::now();
+            Block y_first = run_fused(x_vec[0]);
+            chrono::duration<double, micro> fused_time = chrono::steady_clock::now() - time_start;
+
+            // Measure the overhead of the threads in one iteration.
+            time_start = chrono::steady_clock::now();
+            vector<future<void>> futures;
+            for (size_t k=0; k<K; k++)
+            {
+                futures.push_back(async(launch::async, [] {}));
+            }
+            for (auto& f : futures)
+            {
+                f.get();
+            }
+            chrono::duration<double, micro> overhead = chrono::steady_clock::now() - time_start;
+
+            // The pipeline is at best K times faster, and also slower because
+            // the naive stages do not use the cache as well as the fused ones.
+            double pipelined_time = fused_time.count() / min(K, num_cores) + overhead.count();
+            bool use_pipeline = num_cores > 1 && pipelined_time < 0.8 * fused_time.count();
+
+            choice = (use_pipeline ? "pipelined" : "fused serial") +
+                     string(" (fused ") + to_string(fused_time.count()) + "us per block"
+                     ", pipelined estimate " + to_string(pipelined_time) + "us"
+                     ", " + to_string(num_cores) + " cores)";
+
+            // The first block has already been processed.
+            vector<Block> y_vec;
+            y_vec.push_back(move(y_first));
+
+            if (use_pipeline)
+            {
+                vector<Block> y_rest = run_pipelined(x_vec, 1);
+                y_vec.insert(y_vec.end(), make_move_iterator(y_rest.begin()), make_move_iterator(y_rest.end()));
+                return y_vec;
+            }
+
+            for (size_t i=1; i<x_vec.size(); i++)
+            {
+                y_vec.push_back(run_fused(x_vec[i]));
+            }
+            return y_vec;
+        }
+
+        /** Description of the executor chosen by the last call of process(). */
+        string const& chosen() const
+        {
+            return choice;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,257 @@
+/******************************************************************************
+ * Hedged execution of pure processing stages, to cut the tail latency caused
+ * by calls that are occasionally much slower than normal.
+ *
+ * The processing times of real stages have long tails, e.g. because of page
+ * faults or other programs on the same machine. In the lockstep iterations of
+ * main1.cpp to main4.cpp, a single slow call delays the whole iteration,
+ * because all the stage threads are joined at the end of each iteration.
+ *
+ * A pure stage always gives the same output for the same input and has no
+ * side-effects, so it can safely be run twice. When a call of a hedged stage
+ * takes longer than the 95th percentile of its recent processing times, a
+ * duplicate call is started in another worker thread, and the result of
+ * whichever call finishes first is used. The other call cannot be
+ * interrupted, so it runs to the end in the background and its result is
+ * ignored. The calls run in a fixed set of persistent worker threads, so no
+ * thread is started for each call.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef HEDGE_HPP
+#define HEDGE_HPP
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Wrapper for a pure processing stage, which hedges its slow calls. */
+class HedgedStage
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Result of a single call, which is shared by the original and
+        // duplicate tasks, so it outlives the one that is ignored.
+        struct Call
+        {
+            mutex call_mutex;
+            condition_variable call_cv;
+            bool done = false;
+            bool hedge_won = false;
+            string result;
+        };
+
+        // Pure processing function.
+        function<string(string const&)> func;
+
+        // Percentile of the recent processing times that triggers a hedge.
+        double percentile;
+
+        // Number of recent processing times used for the percentile, and the
+        // number needed before hedging starts.
+        size_t window;
+        size_t min_samples;
+
+        // Recent processing times in milli-sec, used as a ring buffer.
+        vector<double> recent;
+        size_t next_recent = 0;
+
+        // Statistics.
+        long num_calls = 0;
+        long num_hedges = 0;
+        long num_hedge_wins = 0;
+
+        // Tasks for the worker threads, and whether the workers should stop.
+        deque<function<void()>> tasks;
+        bool stop = false;
+
+        // Lock and signal for the tasks.
+        mutex tasks_mutex;
+        condition_variable tasks_cv;
+
+        // Persistent worker threads, which run the original and duplicate
+        // calls, so no thread is started for each call.
+        vector<thread> workers;
+
+        /** Main loop for the worker threads. */
+        void run_worker()
+        {
+            unique_lock<mutex> lock(tasks_mutex);
+            while (true)
+            {
+                tasks_cv.wait(lock, [this] { return stop || !tasks.empty(); });
+
+                // Finish all the tasks before stopping.
+                if (tasks.empty())
+                {
+                    return;
+                }
+
+                function<void()> task = move(tasks.front());
+                tasks.pop_front();
+
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+
+        /** Run the function in a worker thread for the given call. */
+        void start(shared_ptr<Call> call, string const& x, bool is_hedge)
+        {
+            {
+                lock_guard<mutex> lock(tasks_mutex);
+                tasks.push_back([this, call, x, is_hedge]
+                {
+                    string y = func(x);
+
+                    {
+                        lock_guard<mutex> lock(call->call_mutex);
+                        if (!call->done)
+                        {
+                            call->done = true;
+                            call->hedge_won = is_hedge;
+                            call->result = move(y);
+                        }
+                    }
+                    call->call_cv.notify_all();
+                });
+            }
+            tasks_cv.notify_one();
+        }
+
+        /** Time after which a call is hedged, or max if too few samples. */
+        clock_type::duration hedge_delay() const
+        {
+            if (recent.size() < min_samples)
+            {
+                return clock_type::duration::max();
+            }
+
+            vector<double> sorted(recent);
+            size_t idx = min(sorted.size() - 1, (size_t) (percentile * sorted.size()));
+            nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+            return chrono::duration_cast<clock_type::duration>(
+                chrono::duration<double, milli>(sorted[idx]));
+        }
+
+    public:
+        /**
+         * @param func Pure processing function, which must be thread-safe.
+         * @param percentile Percentile of the recent times that triggers a hedge.
+         * @param window Number of recent processing times for the percentile.
+         * @param min_samples Number of processing times needed before hedging.
+         * @param num_workers Number of worker threads. The ignored calls keep
+         *                    a worker busy until they finish, so this should
+         *                    be more than 2.
+         */
+        HedgedStage(function<string(string const&)> func, double percentile = 0.95,
+                    size_t window = 100, size_t min_samples = 20, size_t num_workers = 4)
+            : func(func), percentile(percentile), window(window), min_samples(min_samples)
+        {
+            for (size_t w=0; w<num_workers; w++)
+            {
+                workers.emplace_back(&HedgedStage::run_worker, this);
+            }
+        }
+
+        HedgedStage(HedgedStage const&) = delete;
+        HedgedStage& operator=(HedgedStage const&) = delete;
+
+        /** Wait for the ignored calls that are still running, and stop the workers. */
+        ~HedgedStage()
+        {
+            {
+                lock_guard<mutex> lock(tasks_mutex);
+                stop = true;
+            }
+            tasks_cv.notify_all();
+
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+        }
+
+        /**
+         * Process an input item, and hedge the call if it is slow. This must
+         * only be called by one thread at a time, like the stage functions
+         * in main1.cpp to main4.cpp.
+         *
+         * @param x Input item.
+         * @return Result of the call that finished first.
+         */
+        string operator()(string const& x)
+        {
+            auto time_start = clock_type::now();
+            auto delay = hedge_delay();
+            auto call = make_shared<Call>();
+
+            start(call, x, false);
+
+            unique_lock<mutex> lock(call->call_mutex);
+            bool done = (delay == clock_type::duration::max()) ?
+                (call->call_cv.wait(lock, [&] { return call->done; }), true) :
+                call->call_cv.wait_until(lock, time_start + delay, [&] { return call->done; });
+
+            if (!done)
+            {
+                lock.unlock();
+                start(call, x, true);
+                num_hedges++;
+                lock.lock();
+                call->call_cv.wait(lock, [&] { return call->done; });
+            }
+
+            num_calls++;
+            num_hedge_wins += call->hedge_won;
+
+            // Record the time until the first result for every call, which
+            // is the latency the caller actually saw, so the percentile
+            // includes the slow calls that were hedged.
+            chrono::duration<double, milli> dur = clock_type::now() - time_start;
+            if (recent.size() < window)
+            {
+                recent.push_back(dur.count());
+            }
+            else
+            {
+                recent[next_recent] = dur.count();
+                next_recent = (next_recent + 1) % window;
+            }
+
+            return call->result;
+        }
+
+        /** Fraction of the calls that were hedged. */
+        double hedge_rate() const
+        {
+            return (num_calls > 0) ? (double) num_hedges / num_calls : 0.0;
+        }
+
+        /** Fraction of the hedged calls where the duplicate finished first. */
+        double hedge_win_rate() const
+        {
+            return (num_hedges > 0) ? (double) num_hedge_wins / num_hedges : 0.0;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
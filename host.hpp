@@ -0,0 +1,345 @@
+/******************************************************************************
+ * Adapter that runs a Parallel Pipeline behind a host-style block callback,
+ * as used by audio plugins in a Digital Audio Workstation (DAW):
+ *
+ *      process(const float* in, float* out, int n)
+ *
+ * The stages run in persistent threads, which are started once instead of
+ * once per iteration. The callback never waits for the stage threads. It
+ * only copies the input block to the pipeline, copies the finished output
+ * block from the pipeline, and signals the stage threads to start the next
+ * iteration. If the stage threads have not finished the previous iteration
+ * when the callback is called, then the callback outputs silence and counts
+ * an xrun (buffer under-run), instead of blocking the audio thread.
+ *
+ * This file also has a fake audio device, which calls the callback from its
+ * own thread with a precise period, so the xruns can be measured under load.
+ *
+ * This uses POSIX semaphores so it only works on Linux and similar systems.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef HOST_HPP
+#define HOST_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <semaphore.h>
+
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Adapter for running a chain of processing stages y = S_K(...S_1(x)) as a
+ * Parallel Pipeline behind a host-style block callback.
+ *
+ * In the iteration started by callback i, stage k processes the output that
+ * stage k-1 produced in iteration i-1, just like F_buffer and G_buffer in
+ * main2.cpp. Each stage has two output buffers that are swapped between the
+ * iterations, so stage k can write its new output while stage k+1 reads the
+ * output from the previous iteration.
+ */
+class PipelineHost
+{
+    private:
+        // Processing stages.
+        vector<function<Block(Block const&)>> stages;
+
+        // Number of samples in each callback.
+        int block_size;
+
+        // Input block for the first stage, written by the callback.
+        Block input;
+
+        // Double-buffered output of each stage, where output[k][i % 2] is
+        // written by stage k in iteration i.
+        vector<array<Block, 2>> output;
+
+        // Semaphore for each stage thread to start the next iteration.
+        vector<sem_t> start;
+
+        // Number of iterations finished by each stage thread.
+        vector<atomic<long>> finished;
+
+        // Number of iterations started by the callback.
+        long num_started = 0;
+
+        // Number of callbacks where the pipeline was not ready.
+        atomic<long> num_xruns{0};
+
+        // Whether the stage threads should stop.
+        atomic<bool> stop{false};
+
+        // Persistent stage threads.
+        vector<thread> threads;
+
+        /** Main loop for the thread running stage k. */
+        void run_stage(size_t k)
+        {
+            for (long i=0; ; i++)
+            {
+                // Wait for the callback to start the next iteration.
+                sem_wait(&start[k]);
+
+                if (stop.load())
+                {
+                    return;
+                }
+
+                // Input is either from the callback or from the previous stage
+                // in the previous iteration. Bubbles are skipped.
+                Block const& x = (k == 0) ? input : output[k - 1][(i + 1) % 2];
+                output[k][i % 2] = is_no_data(x) ? Block() : stages[k](x);
+
+                finished[k].store(i + 1, memory_order_release);
+            }
+        }
+
+    public:
+        /**
+         * Create the adapter and start the persistent stage threads.
+         *
+         * @param stages Processing stages in the order they are applied.
+         * @param block_size Number of samples in each callback.
+         */
+        PipelineHost(vector<function<Block(Block const&)>> const& stages, int block_size)
+            : stages(stages), block_size(block_size), output(stages.size()),
+              start(stages.size()), finished(stages.size())
+        {
+            if (stages.empty())
+            {
+                throw invalid_argument("PipelineHost needs a stage.");
+            }
+
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                sem_init(&start[k], 0, 0);
+                finished[k].store(0);
+            }
+
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                threads.emplace_back(&PipelineHost::run_stage, this, k);
+            }
+        }
+
+        PipelineHost(PipelineHost const&) = delete;
+        PipelineHost& operator=(PipelineHost const&) = delete;
+
+        /** Stop and join the stage threads. */
+        ~PipelineHost()
+        {
+            // Wait for the last iteration to finish so the stage threads are
+            // all waiting for their semaphores.
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                while (finished[k].load(memory_order_acquire) < num_started)
+                {
+                    this_thread::yield();
+                }
+            }
+
+            stop.store(true);
+
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                sem_post(&start[k]);
+            }
+
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+
+            for (auto& s : start)
+            {
+                sem_destroy(&s);
+            }
+        }
+
+        /**
+         * Latency in samples added by the pipeline, which is one block for
+         * each stage, because the output of callback i is the result for the
+         * input of callback i-K where K is the number of stages.
+         */
+        int latency() const
+        {
+            return (int) stages.size() * block_size;
+        }
+
+        /** Number of callbacks where the pipeline was not ready in time. */
+        long xruns() const
+        {
+            return num_xruns.load();
+        }
+
+        /**
+         * Host-style block callback, which never blocks.
+         *
+         * @param in Input samples.
+         * @param out Output samples.
+         * @param n Number of samples, which must equal the block size.
+         */
+        void process(float const* in, float* out, int n)
+        {
+            if (n != block_size)
+            {
+                throw invalid_argument("PipelineHost got wrong block size.");
+            }
+
+            // Check if all stages have finished the previous iteration.
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                if (finished[k].load(memory_order_acquire) < num_started)
+                {
+                    // The pipeline is not ready, so output silence and drop the
+                    // input, instead of waiting for the stage threads.
+                    fill(out, out + n, 0.0f);
+                    num_xruns.fetch_add(1);
+                    return;
+                }
+            }
+
+            // Copy the output of the last stage from the previous iteration,
+            // or output silence while the pipeline is being filled.
+            Block const& y = output.back()[(num_started + 1) % 2];
+            for (int i=0; i<n; i++)
+            {
+                out[i] = is_no_data(y) ? 0.0f : y.at(i);
+            }
+
+            // Copy the input for the first stage, reusing its memory.
+            input.data.assign(in, in + n);
+            input.size = n;
+            input.is_constant = false;
+
+            // Start the next iteration in all the stage threads.
+            num_started++;
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                sem_post(&start[k]);
+            }
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Fake audio device, which calls a block callback from its own thread with a
+ * precise period, like the audio clock of a sound card. The deadline of each
+ * callback is the start of the next period. A callback that returns after
+ * its deadline is counted as a missed callback, and the device then skips
+ * the periods it has missed, like a real device would.
+ */
+class FakeDevice
+{
+    private:
+        // Number of samples in each callback.
+        int block_size;
+
+        // Sample rate in Hz.
+        int sample_rate;
+
+        // Number of callbacks that missed their deadline.
+        long num_missed = 0;
+
+        // Max duration of a callback in milli-sec.
+        double max_callback_ms = 0;
+
+    public:
+        /**
+         * Create a fake audio device.
+         *
+         * @param block_size Number of samples in each callback.
+         * @param sample_rate Sample rate in Hz.
+         */
+        FakeDevice(int block_size, int sample_rate)
+            : block_size(block_size), sample_rate(sample_rate) {}
+
+        /** Period of the callbacks. */
+        chrono::nanoseconds period() const
+        {
+            return chrono::nanoseconds((long long) 1e9 * block_size / sample_rate);
+        }
+
+        /**
+         * Run the device for a number of periods. The input is a sine-wave.
+         *
+         * @param callback Block callback e.g. PipelineHost::process.
+         * @param num_periods Number of periods to run.
+         */
+        void run(function<void(float const*, float*, int)> callback, long num_periods)
+        {
+            num_missed = 0;
+            max_callback_ms = 0;
+
+            auto device_thread = [&]()
+            {
+                vector<float> in(block_size);
+                vector<float> out(block_size);
+
+                using clock = chrono::steady_clock;
+                auto deadline = clock::now() + period();
+
+                for (long p=0; p<num_periods; p++)
+                {
+                    // Input samples for this period.
+                    for (int i=0; i<block_size; i++)
+                    {
+                        in[i] = sin(0.01f * (p * block_size + i));
+                    }
+
+                    auto time_start = clock::now();
+                    callback(in.data(), out.data(), block_size);
+                    auto time_end = clock::now();
+
+                    chrono::duration<double, milli> dur = time_end - time_start;
+                    max_callback_ms = max(max_callback_ms, dur.count());
+
+                    // Skip the periods that were missed.
+                    while (time_end > deadline)
+                    {
+                        num_missed++;
+                        deadline += period();
+                        p++;
+                    }
+
+                    // Wait for the next period of the device clock.
+                    this_thread::sleep_until(deadline);
+                    deadline += period();
+                }
+            };
+
+            thread t(device_thread);
+            t.join();
+        }
+
+        /** Number of callbacks that missed their deadline in the last run. */
+        long missed() const
+        {
+            return num_missed;
+        }
+
+        /** Max duration of a callback in milli-sec in the last run. */
+        double max_callback() const
+        {
+            return max_callback_ms;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,281 @@
+/******************************************************************************
+ * Pool of large buffers backed by huge pages, for pipelines whose blocks are
+ * megabytes, e.g. video frames or long partitions of FFT convolution.
+ *
+ * The Block in block.hpp has its samples in a std::vector, so each stage
+ * allocates a new vector for its output in every iteration. For blocks of
+ * several megabytes, the memory comes directly from the OS and is returned
+ * when the block is freed, so every iteration pays a page fault for each
+ * 4 KB page of every new block. The stages also walk memory that needs many
+ * entries in the TLB of the CPU, which can only cache the addresses of a few
+ * thousand pages, so TLB misses are common when a stage reads with a stride.
+ *
+ * The pool instead allocates all its buffers once, and backs them with huge
+ * pages of typically 2 MB, so a buffer of 8 MB needs 4 TLB entries instead of
+ * 2048. Explicit huge pages (MAP_HUGETLB) must be reserved by the system
+ * administrator, so the pool falls back to transparent huge pages (madvise)
+ * and then to normal pages. All the memory is pre-faulted when the pool is
+ * made, so the first iterations of the pipeline do not pay the page faults.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef HUGEPAGE_HPP
+#define HUGEPAGE_HPP
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Kind of memory pages backing a buffer pool. */
+enum class PageMode
+{
+    // Normal pages of typically 4 KB.
+    Normal,
+
+    // Transparent huge pages, which the kernel uses if it can (madvise).
+    Transparent,
+
+    // Explicit huge pages, which must be reserved in advance (MAP_HUGETLB).
+    Explicit
+};
+
+/** Name of the page mode for printing. */
+string to_string(PageMode mode)
+{
+    switch (mode)
+    {
+        case PageMode::Explicit: return "explicit huge pages";
+        case PageMode::Transparent: return "transparent huge pages";
+        default: return "normal pages";
+    }
+}
+
+/**
+ * Size of a huge page in bytes, read from /proc/meminfo.
+ *
+ * @return Size of a huge page, or 2 MB if it cannot be read.
+ */
+size_t huge_page_size()
+{
+    ifstream meminfo("/proc/meminfo");
+    string key;
+    size_t value;
+    while (meminfo >> key >> value)
+    {
+        if (key == "Hugepagesize:")
+        {
+            return value * 1024;
+        }
+        meminfo.ignore(256, '\n');
+    }
+    return 2 << 20;
+}
+
+/**
+ * Number of KB of the process that is currently backed by transparent huge
+ * pages, read from /proc/self/smaps_rollup. This is used to check whether
+ * the kernel actually gave us huge pages.
+ *
+ * @return Number of KB, or 0 if it cannot be read.
+ */
+size_t anon_huge_kb()
+{
+    ifstream smaps("/proc/self/smaps_rollup");
+    string line;
+    while (getline(smaps, line))
+    {
+        if (line.compare(0, 14, "AnonHugePages:") == 0)
+        {
+            return stoul(line.substr(14));
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+
+/**
+ * Pool of buffers with the same size, which are allocated and pre-faulted
+ * once. The buffers are acquired and released by the stage threads, and the
+ * pool must outlive them.
+ */
+class BufferPool
+{
+    private:
+        // Start of the memory for all the buffers, and its size in bytes.
+        char* memory = nullptr;
+        size_t memory_bytes = 0;
+
+        // Number of floats in each buffer.
+        size_t buffer_size;
+
+        // Distance in bytes between the buffers.
+        size_t stride;
+
+        // Kind of pages that back the memory.
+        PageMode page_mode = PageMode::Normal;
+
+        // Buffers that are not in use. This never grows beyond its
+        // initial capacity, so acquire() and release() never allocate.
+        vector<float*> free_buffers;
+
+        // Lock for the free buffers.
+        mutex pool_mutex;
+
+        /** Map memory aligned to a huge page for transparent huge pages. */
+        void map_aligned(size_t align)
+        {
+            // Map extra memory, and unmap the parts before and after the
+            // aligned region.
+            size_t size = memory_bytes + align;
+            void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED)
+            {
+                throw runtime_error("Cannot map memory for BufferPool.");
+            }
+
+            uintptr_t begin = (uintptr_t) addr;
+            uintptr_t aligned = (begin + align - 1) / align * align;
+            if (aligned > begin)
+            {
+                munmap(addr, aligned - begin);
+            }
+            if (begin + size > aligned + memory_bytes)
+            {
+                munmap((void*) (aligned + memory_bytes), begin + size - (aligned + memory_bytes));
+            }
+
+            memory = (char*) aligned;
+        }
+
+    public:
+        /**
+         * @param num_buffers Number of buffers in the pool.
+         * @param buffer_size Number of floats in each buffer.
+         * @param mode Preferred kind of pages, with fallback to the others.
+         */
+        BufferPool(size_t num_buffers, size_t buffer_size, PageMode mode = PageMode::Explicit)
+            : buffer_size(buffer_size)
+        {
+            // Each buffer starts on its own page, so it does not share a
+            // huge page with another buffer.
+            size_t page = (mode == PageMode::Normal) ? sysconf(_SC_PAGESIZE) : huge_page_size();
+            stride = (buffer_size * sizeof(float) + page - 1) / page * page;
+            memory_bytes = num_buffers * stride;
+
+            if (mode == PageMode::Explicit)
+            {
+                // MAP_POPULATE pre-faults the memory, and fails if there are
+                // not enough reserved huge pages.
+                void* addr = mmap(nullptr, memory_bytes, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+                if (addr != MAP_FAILED)
+                {
+                    memory = (char*) addr;
+                    page_mode = PageMode::Explicit;
+                }
+            }
+
+            if (memory == nullptr && mode != PageMode::Normal)
+            {
+                map_aligned(page);
+                if (madvise(memory, memory_bytes, MADV_HUGEPAGE) == 0)
+                {
+                    page_mode = PageMode::Transparent;
+                }
+            }
+
+            if (memory == nullptr)
+            {
+                map_aligned(sysconf(_SC_PAGESIZE));
+            }
+
+            // Pre-fault all the pages by writing to them, so the kernel maps
+            // them now instead of in the first iterations of the pipeline.
+            if (page_mode != PageMode::Explicit)
+            {
+                size_t step = sysconf(_SC_PAGESIZE);
+                for (size_t i=0; i<memory_bytes; i+=step)
+                {
+                    memory[i] = 0;
+                }
+            }
+
+            free_buffers.reserve(num_buffers);
+            for (size_t i=0; i<num_buffers; i++)
+            {
+                free_buffers.push_back((float*) (memory + i * stride));
+            }
+        }
+
+        BufferPool(BufferPool const&) = delete;
+        BufferPool& operator=(BufferPool const&) = delete;
+
+        ~BufferPool()
+        {
+            munmap(memory, memory_bytes);
+        }
+
+        /**
+         * Get a buffer which is not in use.
+         *
+         * @return Pointer to buffer_size() floats.
+         */
+        float* acquire()
+        {
+            lock_guard<mutex> lock(pool_mutex);
+            if (free_buffers.empty())
+            {
+                throw runtime_error("BufferPool has no free buffers.");
+            }
+            float* buffer = free_buffers.back();
+            free_buffers.pop_back();
+            return buffer;
+        }
+
+        /** Return a buffer to the pool. */
+        void release(float* buffer)
+        {
+            if (buffer == nullptr)
+            {
+                return;
+            }
+            lock_guard<mutex> lock(pool_mutex);
+            free_buffers.push_back(buffer);
+        }
+
+        /** Number of floats in each buffer. */
+        size_t size() const
+        {
+            return buffer_size;
+        }
+
+        /** Kind of pages that actually back the memory, after fallback. */
+        PageMode mode() const
+        {
+            return page_mode;
+        }
+
+        /** Description of the pool for printing. */
+        string describe() const
+        {
+            return to_string(memory_bytes / stride) + " buffers of " +
+                   to_string(buffer_size * sizeof(float) / 1024) + " KB with " + to_string(page_mode);
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,254 @@
+/******************************************************************************
+ * Join of two streams with timestamps, which may have different rates and
+ * arrive with jitter, e.g. an audio stream and a sidechain or sensor stream.
+ *
+ * main4.cpp pairs x[i] with z[i] by their index, which only works when the
+ * two streams have the same rate. Here each item has a timestamp instead.
+ * The primary stream x decides the rate of the joined output, and each item
+ * of x is paired with the item of the secondary stream z which is nearest
+ * in time, if it is within a time window.
+ *
+ * An item of x is emitted as soon as the watermark of z has reached its
+ * timestamp, because the later items of z are then further away in time, so
+ * no nearer match can arrive. But if z is late, the item of x is emitted
+ * anyway after a max waiting time, so the pipeline is not stalled by the
+ * slowest source. The buffers for both streams are bounded, and the oldest
+ * items are dropped when they are full.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef JOIN_HPP
+#define JOIN_HPP
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <condition_variable>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Item in a stream with a timestamp in milli-sec. */
+struct Stamped
+{
+    // Timestamp in milli-sec.
+    double time;
+
+    // Data of the item.
+    string value;
+};
+
+/*****************************************************************************/
+
+/**
+ * Join of a primary stream x and a secondary stream z by their timestamps.
+ * The timestamps must be increasing within each stream. The push-functions
+ * are called by the source threads and pop() is called by the pipeline.
+ */
+class TimeJoin
+{
+    private:
+        // Type used for the waiting time.
+        using clock_type = chrono::steady_clock;
+
+        // Item of x and the time it arrived.
+        struct Arrival
+        {
+            Stamped item;
+            clock_type::time_point arrived;
+        };
+
+        // Max time-difference in milli-sec between paired items.
+        double window;
+
+        // Max time an item of x waits for the watermark of z.
+        chrono::milliseconds max_wait;
+
+        // Max number of buffered items for each stream.
+        size_t capacity;
+
+        // Buffered items of both streams.
+        deque<Arrival> x_buffer;
+        deque<Stamped> z_buffer;
+
+        // Largest timestamp of z seen so far.
+        double z_watermark = -INFINITY;
+
+        // Whether the streams have ended.
+        bool x_closed = false;
+        bool z_closed = false;
+
+        // Number of items dropped because the buffers were full.
+        long num_dropped = 0;
+
+        // Number of items of x that were emitted without waiting for z.
+        long num_timeouts = 0;
+
+        // Lock and signal for the buffers.
+        mutex buffer_mutex;
+        condition_variable buffer_cv;
+
+        /** Whether the front item of x can be emitted now. */
+        bool ready(clock_type::time_point now) const
+        {
+            if (x_buffer.empty())
+            {
+                return false;
+            }
+
+            Arrival const& x = x_buffer.front();
+
+            return z_closed ||
+                   z_watermark >= x.item.time ||
+                   now >= x.arrived + max_wait;
+        }
+
+    public:
+        /**
+         * Create a join of two streams.
+         *
+         * @param window Max time-difference in milli-sec between paired items.
+         * @param max_wait Max time an item of x waits for z.
+         * @param capacity Max number of buffered items for each stream.
+         */
+        TimeJoin(double window, chrono::milliseconds max_wait, size_t capacity = 16)
+            : window(window), max_wait(max_wait), capacity(capacity) {}
+
+        /** Add an item to the primary stream x. */
+        void push_x(Stamped const& item)
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+
+            if (x_buffer.size() >= capacity)
+            {
+                x_buffer.pop_front();
+                num_dropped++;
+            }
+
+            x_buffer.push_back({item, clock_type::now()});
+            buffer_cv.notify_all();
+        }
+
+        /** Add an item to the secondary stream z. */
+        void push_z(Stamped const& item)
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+
+            if (z_buffer.size() >= capacity)
+            {
+                z_buffer.pop_front();
+                num_dropped++;
+            }
+
+            z_buffer.push_back(item);
+            z_watermark = max(z_watermark, item.time);
+            buffer_cv.notify_all();
+        }
+
+        /** Mark the end of the primary stream x. */
+        void close_x()
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+            x_closed = true;
+            buffer_cv.notify_all();
+        }
+
+        /** Mark the end of the secondary stream z. */
+        void close_z()
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+            z_closed = true;
+            buffer_cv.notify_all();
+        }
+
+        /**
+         * Wait for the next item of x and pair it with the nearest item of z.
+         *
+         * @param x Output item of x.
+         * @param z Output value of z, or no_data if there was no match.
+         * @return Whether there was an item, or false at the end of x.
+         */
+        bool pop(Stamped& x, string& z)
+        {
+            unique_lock<mutex> lock(buffer_mutex);
+
+            while (true)
+            {
+                auto now = clock_type::now();
+
+                if (ready(now))
+                {
+                    break;
+                }
+
+                if (x_buffer.empty())
+                {
+                    if (x_closed)
+                    {
+                        return false;
+                    }
+                    buffer_cv.wait(lock);
+                }
+                else
+                {
+                    buffer_cv.wait_until(lock, x_buffer.front().arrived + max_wait);
+                }
+            }
+
+            Arrival arrival = x_buffer.front();
+            x_buffer.pop_front();
+            x = arrival.item;
+
+            if (!z_closed && z_watermark < x.time)
+            {
+                num_timeouts++;
+            }
+
+            // Remove items of z that are too old to match this or later items.
+            while (!z_buffer.empty() && z_buffer.front().time < x.time - window)
+            {
+                z_buffer.pop_front();
+            }
+
+            // Find the nearest item of z within the time window.
+            z = no_data;
+            double best = window;
+            for (auto const& item : z_buffer)
+            {
+                double dif = fabs(item.time - x.time);
+                if (dif <= best)
+                {
+                    best = dif;
+                    z = item.value;
+                }
+            }
+
+            return true;
+        }
+
+        /** Number of items dropped because the buffers were full. */
+        long dropped()
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+            return num_dropped;
+        }
+
+        /** Number of items of x emitted before the watermark of z. */
+        long timeouts()
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+            return num_timeouts;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,352 @@
+/******************************************************************************
+ * Parallel Pipeline for audio stages that need samples after the current
+ * block, e.g. limiters, resamplers and centered FIR filters.
+ *
+ * In main1.cpp to main4.cpp, each stage gets one item and outputs one item,
+ * so a stage cannot look at the samples after its current block. Here each
+ * stage declares its lookahead as a number of samples, and gets a window of
+ * its block size plus the lookahead. The stage is then delayed by enough
+ * iterations that the previous stage has produced all the samples in the
+ * window, and this delay is included in the latency of the pipeline.
+ *
+ * The output of each stage is written directly into a ring buffer which is
+ * mapped twice in a row in virtual memory, so a window that wraps around the
+ * end of the ring buffer is still contiguous in memory. The overlapping
+ * windows of the next stage are then just pointers into the ring buffer, and
+ * no samples are copied between the stages.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef LOOKAHEAD_HPP
+#define LOOKAHEAD_HPP
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <future>
+#include <cstring>
+#include <stdexcept>
+#include <functional>
+
+#include "common.hpp"
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Ring buffer of samples which is mapped twice in a row in virtual memory,
+ * so any window of up to capacity() samples is contiguous in memory, even
+ * when it wraps around the end of the ring buffer.
+ */
+class MirrorBuffer
+{
+    private:
+        // Start of the two mappings.
+        float* base = nullptr;
+
+        // Number of samples in the ring buffer.
+        size_t num_samples = 0;
+
+        // Number of bytes in one mapping.
+        size_t num_bytes = 0;
+
+    public:
+        /**
+         * @param min_samples Min number of samples, which is rounded up to a
+         *                    whole number of memory pages.
+         */
+        MirrorBuffer(size_t min_samples)
+        {
+            size_t page = sysconf(_SC_PAGESIZE);
+            num_bytes = (min_samples * sizeof(float) + page - 1) / page * page;
+            num_samples = num_bytes / sizeof(float);
+
+            int fd = memfd_create("mirror_buffer", 0);
+            if (fd < 0 || ftruncate(fd, num_bytes) != 0)
+            {
+                if (fd >= 0) close(fd);
+                throw runtime_error("Cannot create memory for MirrorBuffer.");
+            }
+
+            // Reserve twice the address space, then map the memory into both halves.
+            void* addr = mmap(nullptr, 2 * num_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            bool ok = addr != MAP_FAILED &&
+                mmap(addr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                mmap((char*) addr + num_bytes, num_bytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+            close(fd);
+
+            if (!ok)
+            {
+                if (addr != MAP_FAILED) munmap(addr, 2 * num_bytes);
+                throw runtime_error("Cannot map memory for MirrorBuffer.");
+            }
+
+            base = (float*) addr;
+        }
+
+        MirrorBuffer(MirrorBuffer const&) = delete;
+        MirrorBuffer& operator=(MirrorBuffer const&) = delete;
+
+        ~MirrorBuffer()
+        {
+            munmap(base, 2 * num_bytes);
+        }
+
+        /** Number of samples in the ring buffer. */
+        size_t capacity() const
+        {
+            return num_samples;
+        }
+
+        /**
+         * Pointer to the sample at a position in the stream, which is
+         * contiguous for capacity() samples.
+         */
+        float* at(size_t pos)
+        {
+            return base + pos % num_samples;
+        }
+
+        /** Fill the ring buffer with zeros. */
+        void clear()
+        {
+            memset(base, 0, num_bytes);
+        }
+};
+
+/*****************************************************************************/
+
+/** Processing stage which needs samples after its current block. */
+struct LookaheadStage
+{
+    // Name of the stage for printing.
+    string name;
+
+    // Number of samples needed after the current block.
+    size_t lookahead;
+
+    // Process n samples. The input has n + lookahead samples, where the
+    // first n are the current block, and the output has n samples.
+    function<void(float const* in, float* out, size_t n)> process;
+};
+
+/*****************************************************************************/
+
+/** Parallel Pipeline for a chain of stages with lookahead. */
+class LookaheadPipeline
+{
+    private:
+        // Processing stages.
+        vector<LookaheadStage> stages;
+
+        // Number of samples in each block.
+        size_t block_size;
+
+        // Delay of each stage in iterations.
+        vector<size_t> delays;
+
+        // Ring buffers for the input stream and the output of each stage.
+        vector<unique_ptr<MirrorBuffer>> buffers;
+
+        /** Number of blocks needed for the lookahead of stage k. */
+        size_t lookahead_blocks(size_t k) const
+        {
+            return (stages[k].lookahead + block_size - 1) / block_size;
+        }
+
+    public:
+        /**
+         * @param stages Processing stages in the order they are applied.
+         * @param block_size Number of samples in each block.
+         */
+        LookaheadPipeline(vector<LookaheadStage> const& stages, size_t block_size)
+            : stages(stages), block_size(block_size)
+        {
+            size_t K = stages.size();
+            if (K == 0)
+            {
+                throw invalid_argument("LookaheadPipeline needs a stage.");
+            }
+
+            // Stage 0 can read the input block of the current iteration,
+            // while the other stages read the output of the previous stage
+            // from the previous iteration, like F_buffer in main2.cpp.
+            delays.resize(K);
+            for (size_t k=0; k<K; k++)
+            {
+                delays[k] = (k == 0 ? 0 : delays[k - 1] + 1) + lookahead_blocks(k);
+            }
+
+            // Buffer k is written by stage k-1 and read by stage k, with the
+            // input stream as buffer 0. It must hold the window of stage k
+            // plus the block being written by stage k-1 at the same time.
+            for (size_t k=0; k<=K; k++)
+            {
+                size_t blocks = (k < K) ? lookahead_blocks(k) + 2 : 2;
+                buffers.emplace_back(new MirrorBuffer(blocks * block_size));
+            }
+        }
+
+        /** Total lookahead in samples of all the stages. */
+        size_t lookahead() const
+        {
+            size_t total = 0;
+            for (auto const& stage : stages)
+            {
+                total += stage.lookahead;
+            }
+            return total;
+        }
+
+        /**
+         * Latency in blocks from an input block to the output block with the
+         * same samples, including the lookahead of the stages.
+         */
+        size_t latency_blocks() const
+        {
+            return delays.back() + 1;
+        }
+
+        /** Latency in samples, which is used for latency compensation. */
+        size_t latency_samples() const
+        {
+            return latency_blocks() * block_size;
+        }
+
+        /** Description of the delays for printing. */
+        string describe() const
+        {
+            string desc;
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                desc += stages[k].name + ": lookahead " + to_string(stages[k].lookahead) +
+                        " samples, delay " + to_string(delays[k]) + " iterations\n";
+            }
+            desc += "Total lookahead: " + to_string(lookahead()) + " samples, latency: " +
+                    to_string(latency_blocks()) + " blocks = " + to_string(latency_samples()) + " samples";
+            return desc;
+        }
+
+        /**
+         * Serial processing of the whole stream, one stage at a time, which
+         * is used to check the pipeline. The stream is padded with zeros
+         * after the end for the lookahead.
+         *
+         * @param x Input samples, which must be a whole number of blocks.
+         * @return Output samples.
+         */
+        vector<float> serial(vector<float> const& x) const
+        {
+            if (x.size() % block_size != 0)
+            {
+                throw invalid_argument("LookaheadPipeline got a partial block.");
+            }
+
+            vector<float> y = x;
+            for (auto const& stage : stages)
+            {
+                vector<float> in = y;
+                in.resize(y.size() + stage.lookahead + block_size, 0.0f);
+                for (size_t b=0; b<y.size(); b+=block_size)
+                {
+                    stage.process(in.data() + b, y.data() + b, block_size);
+                }
+            }
+            return y;
+        }
+
+        /**
+         * Parallel processing of the blocks, where each stage runs in its own
+         * thread. The output blocks are aligned with the input blocks, so the
+         * latency is compensated for the caller, and the stream is padded
+         * with zeros after the end for the lookahead.
+         *
+         * @param x_vec Input blocks, which must all have block_size samples.
+         * @return Output blocks.
+         */
+        vector<Block> parallel(vector<Block> const& x_vec)
+        {
+            size_t K = stages.size();
+            size_t n = x_vec.size();
+            size_t N = block_size;
+            vector<Block> y_vec;
+
+            for (auto const& x : x_vec)
+            {
+                if (x.size != N)
+                {
+                    throw invalid_argument("LookaheadPipeline got wrong block size.");
+                }
+            }
+
+            for (auto& buffer : buffers)
+            {
+                buffer->clear();
+            }
+
+            for (size_t i=0; i<n + delays.back(); i++)
+            {
+                // Write the new input block, or zeros after the end.
+                float* in = buffers[0]->at(i * N);
+                for (size_t s=0; s<N; s++)
+                {
+                    in[s] = (i < n) ? x_vec[i].at(s) : 0.0f;
+                }
+
+                // Each stage processes its block j in its own thread, reading a
+                // window of buffer k and writing to buffer k+1. Bubbles are skipped.
+                vector<future<void>> futures;
+                for (size_t k=0; k<K; k++)
+                {
+                    if (i < delays[k])
+                    {
+                        continue;
+                    }
+
+                    // After the end of the stream, the stage outputs zeros
+                    // for the lookahead of the next stage.
+                    size_t j = i - delays[k];
+                    if (j >= n)
+                    {
+                        memset(buffers[k + 1]->at(j * N), 0, N * sizeof(float));
+                        continue;
+                    }
+
+                    float const* window = buffers[k]->at(j * N);
+                    float* out = buffers[k + 1]->at(j * N);
+                    auto const& process = stages[k].process;
+
+                    futures.push_back(async(launch::async, [&process, window, out, N]
+                    {
+                        process(window, out, N);
+                    }));
+                }
+
+                for (auto& future : futures)
+                {
+                    future.get();
+                }
+
+                // Output block of the last stage.
+                if (i >= delays.back())
+                {
+                    float const* out = buffers[K]->at((i - delays.back()) * N);
+                    y_vec.push_back(make_block(vector<float>(out, out + N)));
+                }
+            }
+
+            return y_vec;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
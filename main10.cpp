@@ -0,0 +1,116 @@
+/******************************************************************************
+ * Example 10 shows how to run the Parallel Pipeline from Example 2 behind a
+ * host-style block callback, which is called by a fake audio device with a
+ * precise period. The pipeline calculates the following expression using
+ * 3 persistent threads for the 3 functions F, G and H. The input block for
+ * callback i is denoted x[i] and the output block is y[i].
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The audio device calls the callback every 10 msec, and each of the functions
+ * F, G and H takes 4 msec. When the functions are run in serial inside the
+ * callback, it takes 12 msec so the callback misses its deadline every time.
+ * When the functions are run in the Parallel Pipeline, the callback returns
+ * almost immediately and there are no xruns (missed callbacks), but the
+ * output is delayed by 3 blocks.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "host.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Sample rate and block size of the audio device, so the period is 10 msec.
+static int const sample_rate = 48000;
+static int const block_size = 480;
+
+// Number of callbacks, so each run takes 2 seconds.
+static long const num_periods = 200;
+
+// Processing time for each of the functions F, G and H.
+static auto const stage_time = 4ms;
+
+/*****************************************************************************/
+
+/**
+ * Create a dummy processing stage which simulates heavy processing by
+ * sleeping, and then multiplies the samples with a gain.
+ *
+ * @param gain Gain for the samples.
+ * @return Processing function.
+ */
+function<Block(Block const&)> make_gain_stage(float gain)
+{
+    return [gain](Block const& x)
+    {
+        // Simulate heavy processing.
+        this_thread::sleep_for(stage_time);
+
+        vector<float> data(x.size);
+        for (size_t i=0; i<x.size; i++)
+        {
+            data[i] = gain * x.at(i);
+        }
+
+        return make_block(move(data));
+    };
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Processing functions F, G and H.
+    auto F = make_gain_stage(0.5f);
+    auto G = make_gain_stage(2.0f);
+    auto H = make_gain_stage(1.0f);
+
+    // Fake audio device.
+    FakeDevice device(block_size, sample_rate);
+    cout << "Device period: " << chrono::duration<double, milli>(device.period()).count()
+         << "ms" << endl;
+    cout << endl;
+
+    // Callback that runs the functions in serial.
+    cout << "Serial:" << endl;
+    auto serial_callback = [&](float const* in, float* out, int n)
+    {
+        Block y = H(G(F(make_block(vector<float>(in, in + n)))));
+        copy(y.data.begin(), y.data.end(), out);
+    };
+    device.run(serial_callback, num_periods);
+    cout << "Missed callbacks: " << device.missed() << endl;
+    cout << "Max callback time: " << device.max_callback() << "ms" << endl;
+    cout << "Latency: 0 samples" << endl;
+    cout << endl;
+
+    // Callback that runs the functions in a Parallel Pipeline.
+    cout << "Parallel:" << endl;
+    PipelineHost host({F, G, H}, block_size);
+    auto parallel_callback = [&](float const* in, float* out, int n)
+    {
+        host.process(in, out, n);
+    };
+    device.run(parallel_callback, num_periods);
+    cout << "Missed callbacks: " << device.missed() << endl;
+    cout << "Max callback time: " << device.max_callback() << "ms" << endl;
+    cout << "Pipeline xruns: " << host.xruns() << endl;
+    cout << "Latency: " << host.latency() << " samples" << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
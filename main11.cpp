@@ -0,0 +1,124 @@
+/******************************************************************************
+ * Example 11 shows how to use the hybrid scheduler for a mixer graph, where
+ * several tracks each have a serial chain of effects, and the outputs of the
+ * tracks are summed into a bus. The input for iteration i is x[i] and the
+ * output is y[i]:
+ *
+ *      y[i] = H(G(F(x[i]))) + A(x[i]) + B(x[i]) + C(x[i])
+ *
+ * All the effects take 100 msec and there are 3 worker threads. With only
+ * track-level parallelism, each block takes 300 msec because of the longest
+ * chain H(G(F(x[i]))) on the critical path. The hybrid scheduler splits only
+ * this chain into a Parallel Pipeline with 2 segments, so each block takes
+ * 200 msec, which is the total work divided by the number of workers.
+ *
+ * This introduces 1 extra iteration of latency, and the other tracks are
+ * delayed by 1 iteration so the tracks are still aligned in the bus.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "mixer.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Create a dummy effect which simulates heavy processing.
+ *
+ * @param name Name of the effect.
+ * @return Effect function.
+ */
+Effect make_effect(string const& name)
+{
+    return [name](string const& x)
+    {
+        // Simulate heavy processing.
+        this_thread::sleep_for(sleep_time);
+
+        return name + "(" + x + ")";
+    };
+}
+
+/*****************************************************************************/
+
+/**
+ * Run the mixer with the given number of workers and max latency, and show
+ * the plan, the output and the elapsed time.
+ *
+ * @param title Title to print.
+ * @param tracks Tracks with measured costs.
+ * @param x_vec Input data to be processed.
+ * @param num_workers Number of worker threads.
+ * @param max_latency Max number of blocks of added latency.
+ */
+void run(string const& title, vector<Track> const& tracks,
+         vector<string> const& x_vec, size_t num_workers, size_t max_latency)
+{
+    cout << title << endl;
+
+    Mixer mixer(tracks, num_workers);
+    double planned = mixer.plan(max_latency);
+    cout << mixer.describe() << endl;
+    cout << "Planned time per block: " << planned << "ms" << endl;
+
+    // Start timer.
+    Timer timer;
+
+    vector<string> y_vec = mixer.process(x_vec);
+
+    for (size_t i=0; i<y_vec.size(); i++)
+    {
+        cout << "Output " + to_string(i) + ": " << y_vec[i] << endl;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Tracks in the mixer graph.
+    vector<Track> tracks = {
+        {"Track 1", {make_effect("F"), make_effect("G"), make_effect("H")}, {}},
+        {"Track 2", {make_effect("A")}, {}},
+        {"Track 3", {make_effect("B")}, {}},
+        {"Track 4", {make_effect("C")}, {}}
+    };
+
+    // Measure the cost of each effect.
+    for (auto& track : tracks)
+    {
+        measure(track, "x");
+    }
+
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(5, "x");
+
+    // Serial processing with a single worker.
+    run("Serial:", tracks, x_vec, 1, 0);
+    cout << endl;
+
+    // Only track-level parallelism.
+    run("Parallel tracks:", tracks, x_vec, 3, 0);
+    cout << endl;
+
+    // Both track-level and pipeline-level parallelism.
+    run("Hybrid:", tracks, x_vec, 3, 2);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
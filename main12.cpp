@@ -0,0 +1,141 @@
+/******************************************************************************
+ * Example 12 shows how to use parallelism inside a single stage of the
+ * Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H. The input for iteration i is denoted x[i] and the output is y[i].
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * Each block has 16 independent audio channels. The functions F and H take
+ * 100 msec per block, but the function G takes 25 msec per channel so it
+ * takes 400 msec per block, which makes it the bottleneck of the pipeline.
+ * The function G therefore declares that its channels can be processed in
+ * parallel, using a shared worker pool with 3 worker threads for the spare
+ * cores, which is assumed to be a machine with 6 cores. Together with its own
+ * stage thread, the function G then takes 100 msec per block.
+ *
+ * This introduces 2 extra iterations of latency, as in Example 2.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <functional>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "pool.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Number of channels in each block.
+static size_t const num_channels = 16;
+
+// Number of samples in each block.
+static size_t const block_size = 64;
+
+/*****************************************************************************/
+
+/**
+ * Create a dummy processing function for a single channel, which simulates
+ * heavy processing by sleeping.
+ *
+ * @param time Sleep-time for each channel.
+ * @return Processing function.
+ */
+function<Block(Block const&)> make_channel_func(chrono::microseconds time)
+{
+    return [time](Block const& x)
+    {
+        // Simulate heavy processing.
+        this_thread::sleep_for(time);
+        return x;
+    };
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with multi-channel blocks x[i] to produce
+ * H(G(F(x[i]))) where the functions F, G and H are run in parallel.
+ *
+ * @param x_vec input data to be processed.
+ * @param pool Shared worker pool for the function G, or null.
+ */
+void parallel(vector<Channels> const& x_vec, WorkerPool* pool)
+{
+    cout << "Parallel (" << (pool ? pool->size() : 0) << " workers for G):" << endl;
+
+    // Dummy stages where only G uses the worker pool.
+    auto const t = chrono::duration_cast<chrono::microseconds>(sleep_time);
+    ChannelStage F(make_channel_func(t / num_channels));
+    ChannelStage G(make_channel_func(t / 4), pool);
+    ChannelStage H(make_channel_func(t / num_channels));
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of functions F and G from the previous iteration.
+    Channels F_buffer;
+    Channels G_buffer;
+
+    // For each element in the input vector.
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        // Input block for index i. Or empty block if we are beyond the end.
+        Channels x_i = (i < x_vec.size()) ? x_vec[i] : Channels();
+
+        // Async execution of the functions F, G and H. The function G uses
+        // its own stage thread and the worker pool.
+        auto F_future = async_stage(cref(F), x_i);
+        auto G_future = async_stage(cref(G), F_buffer);
+        auto H_future = async_stage(cref(H), G_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        Channels F_result = F_future.get();
+        Channels G_result = G_future.get();
+        Channels H_result = H_future.get();
+
+        // Save the output of the functions F and G for use as input in the
+        // next iteration of the for-loop.
+        F_buffer = F_result;
+        G_buffer = G_result;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of multi-channel blocks for the input data.
+    vector<Channels> x_vec(10, Channels(num_channels, make_block(vector<float>(block_size))));
+
+    // Parallel processing without the worker pool.
+    parallel(x_vec, nullptr);
+
+    // Show newline.
+    cout << endl;
+
+    // Parallel processing with the worker pool. On a real machine the number
+    // of workers should be spare_cores(3) for the 3 stage threads.
+    WorkerPool pool(3);
+    cout << "Spare cores on this machine: " << spare_cores(3) << endl;
+    parallel(x_vec, &pool);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
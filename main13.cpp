@@ -0,0 +1,167 @@
+/******************************************************************************
+ * Example 13 shows how to join two streams with different rates and jitter
+ * by their timestamps, and use the joined stream in the Parallel Pipeline
+ * from Example 4, which calculates the following mathematical expression
+ * using 3 parallel threads for the 3 functions F, G and H:
+ *
+ *      y[i] = H(F(x[i]) + G(z(t_i)))
+ *
+ * The primary stream x has an item every 100 msec with timestamp t_i, and
+ * the secondary stream z is a sidechain with an item every 150 msec, which
+ * arrives with up to 40 msec of jitter. One item of z is lost. Each item of
+ * x is paired with the item of z that is nearest in time within 75 msec,
+ * or no_data if there is none. The function G is not called for no_data.
+ *
+ * The pipeline runs at the rate of x, and an item of x never waits more
+ * than 100 msec for z, so the slow and jittery sidechain does not stall it.
+ *
+ * This introduces 1 extra iteration of latency, as in Example 4.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <random>
+
+#include "common.hpp"
+#include "join.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Source of a stream, which pushes items with timestamps at a fixed period,
+ * and with random jitter in their arrival times.
+ *
+ * @param push Function for pushing an item.
+ * @param close Function for marking the end of the stream.
+ * @param prefix Prefix for the item strings.
+ * @param n Number of items.
+ * @param period Period in milli-sec.
+ * @param jitter Max jitter in milli-sec.
+ * @param lost Index of an item that is lost, or -1.
+ */
+void source(function<void(Stamped const&)> push, function<void()> close,
+            string const& prefix, int n, int period, int jitter, int lost)
+{
+    auto time_start = chrono::steady_clock::now();
+    mt19937 rng(period);
+    uniform_int_distribution<int> dist(0, jitter);
+
+    for (int i=0; i<n; i++)
+    {
+        // Wait until the item arrives.
+        this_thread::sleep_until(time_start + chrono::milliseconds(i * period + dist(rng)));
+
+        if (i != lost)
+        {
+            push({(double) i * period, prefix + "_" + to_string(i)});
+        }
+    }
+
+    close();
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of the joined streams to produce H(F(x[i]) + G(z(t_i)))
+ * where the functions F, G and H are run in parallel.
+ *
+ * @param join Join of the two streams.
+ */
+void parallel(TimeJoin& join)
+{
+    cout << "Parallel:" << endl;
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of sums of functions F and G from previous iteration.
+    string F_G_sum_buffer(no_data);
+
+    // For each joined item, until the stream has ended.
+    // Note that we need +1 iteration because of the buffering and threading.
+    for (uint i=0; ; i++)
+    {
+        // Wait for the next joined item. Or empty strings after the end.
+        Stamped x;
+        string z_i;
+        bool has_x = join.pop(x, z_i);
+        string x_i = has_x ? x.value : no_data;
+
+        if (!has_x)
+        {
+            z_i = no_data;
+
+            // Stop when the pipeline has been drained.
+            if (F_G_sum_buffer == no_data)
+            {
+                break;
+            }
+        }
+
+        // Async execution of the functions F, G and H.
+        auto F_future = async_stage(F, x_i);
+        auto G_future = async_stage(G, z_i);
+        auto H_future = async_stage(H, F_G_sum_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        string F_result = F_future.get();
+        string G_result = G_future.get();
+        string H_result = H_future.get();
+
+        // Save the sum of the output of the functions F and G for use as input
+        // to the function H in the next iteration of the for-loop.
+        F_G_sum_buffer = sum(F_result, G_result);
+
+        // Show result.
+        cout << "Step " + to_string(i) + ":  Thread 1: " << F_result
+             << "  Thread 2: " << G_result << "  Thread 3: " << H_result << endl;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Join where items are paired within 75 msec, and an item of x waits at
+    // most 100 msec for z.
+    TimeJoin join(75.0, 100ms);
+
+    // Source thread for the primary stream x.
+    thread x_source(source,
+                    [&](Stamped const& item) { join.push_x(item); },
+                    [&]() { join.close_x(); },
+                    "x", 10, 100, 5, -1);
+
+    // Source thread for the secondary stream z, where item 4 is lost.
+    thread z_source(source,
+                    [&](Stamped const& item) { join.push_z(item); },
+                    [&]() { join.close_z(); },
+                    "z", 7, 150, 40, 4);
+
+    // Parallel processing of the joined streams.
+    parallel(join);
+
+    x_source.join();
+    z_source.join();
+
+    cout << "Items dropped: " << join.dropped() << endl;
+    cout << "Items of x emitted before the watermark of z: " << join.timeouts() << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
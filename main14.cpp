@@ -0,0 +1,151 @@
+/******************************************************************************
+ * Example 14 shows how to use the discrete-event simulator to predict the
+ * performance of Parallel Pipelines without running the actual processing
+ * functions.
+ *
+ * First it predicts the elapsed time for the serial and parallel processing
+ * in main1.cpp to main4.cpp, and compares one of the predictions to a real
+ * run of the Parallel Pipeline from main2.cpp.
+ *
+ * Then it explores different ways of running the pipeline y = H(G(F(x)))
+ * from main2.cpp when the function G is slower than F and H, and its time
+ * varies randomly, and a new item arrives every 250 msec: In lockstep as in
+ * main2.cpp, as a dataflow pipeline, with G farmed out to 2 threads, and with
+ * mini-blocks.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+
+#include "common.hpp"
+#include "simulator.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Predict the elapsed time for serial and parallel processing of a graph.
+ *
+ * @param title Title to print.
+ * @param stages Graph of the stages.
+ */
+void predict(string const& title, vector<SimStage> const& stages)
+{
+    SimConfig config;
+    config.num_items = 10;
+
+    config.executor = Executor::Serial;
+    SimResult serial = simulate(stages, config);
+
+    config.executor = Executor::Lockstep;
+    SimResult parallel = simulate(stages, config);
+
+    cout << title << ":  Serial: " << serial.elapsed << "ms"
+         << "  Parallel: " << parallel.elapsed << "ms"
+         << "  Bubbles: " << parallel.bubbles << endl;
+}
+
+/*****************************************************************************/
+
+/**
+ * Real run of the Parallel Pipeline from main2.cpp without printing.
+ *
+ * @param x_vec input data to be processed.
+ */
+void parallel(vector<string> const& x_vec)
+{
+    cout << "Real run of main2.cpp: ";
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F, x_i);
+        auto G_future = async_stage(G, F_buffer);
+        auto H_future = async_stage(H, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        H_future.get();
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Processing time of the dummy functions in milli-sec.
+    double ms = chrono::duration<double, milli>(sleep_time).count();
+
+    // Predictions for the examples main1.cpp to main4.cpp. The summations
+    // are almost free so they are not included in the graphs.
+    predict("main1.cpp", {{"F", constant_cost(ms), {}},
+                          {"G", constant_cost(ms), {0}}});
+    predict("main2.cpp", {{"F", constant_cost(ms), {}},
+                          {"G", constant_cost(ms), {0}},
+                          {"H", constant_cost(ms), {1}}});
+    predict("main3.cpp", {{"F", constant_cost(ms), {}},
+                          {"G", constant_cost(ms), {0}}});
+    predict("main4.cpp", {{"F", constant_cost(ms), {}},
+                          {"G", constant_cost(ms), {}},
+                          {"H", constant_cost(ms), {0, 1}}});
+
+    // Compare to a real run.
+    parallel(gen_vec_string(10, "x"));
+    cout << endl;
+
+    // Pipeline y = H(G(F(x))) where G is slow and varies randomly.
+    vector<SimStage> stages = {{"F", constant_cost(ms), {}},
+                               {"G", normal_cost(2 * ms, 0.2 * ms), {0}},
+                               {"H", constant_cost(ms), {1}}};
+
+    // A new item arrives every 250 msec, as in a real-time stream.
+    SimConfig config;
+    config.num_items = 100;
+    config.num_cores = 4;
+    config.period = 250.0;
+
+    cout << "Unbalanced y = H(G(F(x))) with " << config.num_items << " items arriving every "
+         << config.period << "ms on " << config.num_cores << " cores:" << endl;
+
+    config.executor = Executor::Serial;
+    cout << "Serial:         " << simulate(stages, config).describe() << endl;
+
+    config.executor = Executor::Lockstep;
+    cout << "Lockstep:       " << simulate(stages, config).describe() << endl;
+
+    config.executor = Executor::Dataflow;
+    cout << "Dataflow:       " << simulate(stages, config).describe() << endl;
+
+    stages[1].replicas = 2;
+    cout << "Farmed G x2:    " << simulate(stages, config).describe() << endl;
+
+    config.executor = Executor::Lockstep;
+    config.mini_blocks = 4;
+    config.overhead = 2.0;
+    cout << "Mini-blocks x4: " << simulate(stages, config).describe() << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
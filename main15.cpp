@@ -0,0 +1,140 @@
+/******************************************************************************
+ * Example 15 shows how to record the processing times of the stages in the
+ * Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H. The input for iteration i is denoted x[i] and the output is y[i].
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The functions have varying processing times, like in a real production
+ * system: F waits for I/O for a random time, G computes on the CPU for a
+ * while and then waits, and H takes a fixed time like in common.hpp.
+ *
+ * The processing times are recorded and saved to a binary trace file. The
+ * trace file is then loaded and replayed both in the simulator and as a
+ * synthetic workload in the real pipeline, and the elapsed times are compared.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <random>
+#include <functional>
+
+#include "common.hpp"
+#include "simulator.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Path of the trace file.
+static string const trace_path = "trace.bin";
+
+/** Function F that waits for I/O for a random time. */
+string F_io(string const& x)
+{
+    static thread_local mt19937 rng(1);
+    this_thread::sleep_for(chrono::milliseconds(uniform_int_distribution<int>(50, 150)(rng)));
+    return "F(" + x + ")";
+}
+
+/** Function G that computes on the CPU and then waits. */
+string G_cpu(string const& x)
+{
+    double cpu_end = thread_cpu_ms() + 20.0;
+    while (thread_cpu_ms() < cpu_end) {}
+    this_thread::sleep_for(60ms);
+    return "G(" + x + ")";
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with elements x[i] to produce
+ * H(G(F(x[i]))) where the functions F, G and H are run in parallel.
+ *
+ * @param x_vec input data to be processed.
+ * @param F_func Processing function F.
+ * @param G_func Processing function G.
+ * @param H_func Processing function H.
+ * @return Elapsed time in milli-sec.
+ */
+double parallel(vector<string> const& x_vec,
+                function<string(string const&)> F_func,
+                function<string(string const&)> G_func,
+                function<string(string const&)> H_func)
+{
+    auto time_start = chrono::steady_clock::now();
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        H_future.get();
+    }
+
+    chrono::duration<double, milli> dur = chrono::steady_clock::now() - time_start;
+    return dur.count();
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(20, "x");
+
+    // Record the processing times of a run with the real functions.
+    TraceRecorder recorder;
+    auto F_rec = recorder.wrap<string>("F", F_io);
+    auto G_rec = recorder.wrap<string>("G", G_cpu);
+    auto H_rec = recorder.wrap<string>("H", H);
+
+    double recorded = parallel(x_vec, F_rec, G_rec, H_rec);
+    cout << "Recorded run: " << recorded << "ms" << endl;
+
+    save_trace(recorder.get(), trace_path);
+
+    // Load the trace file, e.g. on another machine for offline tuning.
+    Trace trace = load_trace(trace_path);
+    cout << trace.describe() << endl;
+
+    // Replay the trace in the simulator.
+    vector<SimStage> stages = {{"F", replay_cost(trace, 0), {}},
+                               {"G", replay_cost(trace, 1), {0}},
+                               {"H", replay_cost(trace, 2), {1}}};
+    SimConfig config;
+    config.num_items = x_vec.size();
+    config.num_cores = 3;
+    config.executor = Executor::Lockstep;
+    cout << "Simulated replay: " << simulate(stages, config).elapsed << "ms" << endl;
+
+    // Replay the trace as a synthetic workload in the real pipeline.
+    double replayed = parallel(x_vec, replay_stage(trace, 0), replay_stage(trace, 1),
+                               replay_stage(trace, 2));
+    cout << "Synthetic replay: " << replayed << "ms" << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
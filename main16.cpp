@@ -0,0 +1,136 @@
+/******************************************************************************
+ * Example 16 shows how to run many Parallel Pipelines at the same time in a
+ * shared pool of worker threads, instead of each pipeline having its own
+ * threads as in main1.cpp to main4.cpp.
+ *
+ * A real-time pipeline y = H(G(F(x))) gets a new input item every 50 msec
+ * and must finish each iteration within 50 msec. At the same time, 8 batch
+ * pipelines of the same kind process all their input as fast as possible.
+ * All 9 pipelines share a pool with only 4 worker threads, where they would
+ * otherwise use 27 threads.
+ *
+ * The batch pipelines are also given a budget of 50 msec per iteration, so
+ * their deadlines compete with those of the real-time pipeline. Within a QoS
+ * class, the pool runs the task with the earliest deadline first, and a batch
+ * task that has been waiting in the queue has an earlier deadline than a new
+ * real-time task. The batch pipelines cannot keep up with their budget, so
+ * they miss most of their deadlines in both runs.
+ *
+ * The pipelines are first run with the same QoS class, so the real-time
+ * pipeline has to wait in line with the batch pipelines, and it misses about
+ * half of its deadlines. Then the real-time pipeline is given the QoS class
+ * RealTime, so its tasks preempt the batch pipelines at the boundaries of
+ * their tasks, and it misses none of its deadlines.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "common.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Dummy processing stage that sleeps for a while, like F, G and H in
+ * common.hpp but with a different processing time.
+ *
+ * @param name Name of the stage.
+ * @param time Processing time.
+ * @return Processing function.
+ */
+function<string(string const&)> make_stage(string const& name, chrono::milliseconds time)
+{
+    return [name, time](string const& x)
+    {
+        this_thread::sleep_for(time);
+        return name + "(" + x + ")";
+    };
+}
+
+/*****************************************************************************/
+
+/**
+ * Run the real-time pipeline together with the batch pipelines in a pool.
+ *
+ * @param title Title to print.
+ * @param rt_qos QoS class of the real-time pipeline.
+ */
+void run(string const& title, QoS rt_qos)
+{
+    cout << title << endl;
+
+    // Shared pool with one worker per core.
+    SharedPool pool(4);
+
+    // Real-time pipeline with a new item every 50 msec and a budget of 50 msec.
+    vector<function<string(string const&)>> rt_stages =
+        {make_stage("F", 15ms), make_stage("G", 15ms), make_stage("H", 15ms)};
+    PooledPipeline rt_pipeline(pool, rt_stages, rt_qos, 50ms, 50ms);
+
+    // Batch pipelines with all their input available at the start, and the
+    // same budget as the real-time pipeline.
+    vector<function<string(string const&)>> batch_stages =
+        {make_stage("F", 30ms), make_stage("G", 30ms), make_stage("H", 30ms)};
+    vector<unique_ptr<PooledPipeline>> batch_pipelines;
+    for (int p=0; p<8; p++)
+    {
+        batch_pipelines.emplace_back(new PooledPipeline(pool, batch_stages, QoS::Batch, 0ms, 50ms));
+    }
+
+    // Start timer.
+    Timer timer;
+
+    // Start all the pipelines, which then run in the pool.
+    auto rt_future = rt_pipeline.run(gen_vec_string(40, "x"));
+    vector<future<vector<string>>> batch_futures;
+    for (auto& pipeline : batch_pipelines)
+    {
+        batch_futures.push_back(pipeline->run(gen_vec_string(20, "b")));
+    }
+
+    // Wait for the pipelines to finish.
+    vector<string> y_vec = rt_future.get();
+    for (auto& f : batch_futures)
+    {
+        f.get();
+    }
+
+    cout << "Real-time: " << y_vec.size() << " items, " << rt_pipeline.misses()
+         << " deadline misses, max latency " << rt_pipeline.max_latency() << "ms" << endl;
+    cout << "Last output: " << y_vec.back() << endl;
+
+    long batch_misses = 0;
+    for (auto& pipeline : batch_pipelines)
+    {
+        batch_misses += pipeline->misses();
+    }
+    cout << "Batch: " << batch_misses << " deadline misses" << endl;
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    run("Same QoS class for all pipelines:", QoS::Batch);
+    run("Real-time QoS class for the real-time pipeline:", QoS::RealTime);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
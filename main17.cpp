@@ -0,0 +1,81 @@
+/******************************************************************************
+ * Example 17 shows how the number of active worker threads in a Parallel
+ * Pipeline y = H(G(F(x))) can grow and shrink with the load, instead of
+ * always having a thread for each of the functions as in main2.cpp.
+ *
+ * The input arrives slowly at first, then fast for a while, and then slowly
+ * again, like the load on a server over a day. When the load is low, all the
+ * stages are merged onto a single worker thread. When the load is high, the
+ * stages are split onto more worker threads so the pipeline can keep up.
+ * The decision log shows when the groups of stages were changed and why.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "common.hpp"
+#include "elastic.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Dummy processing stage that sleeps for 30 msec, like F, G and H in
+ * common.hpp but faster.
+ *
+ * @param name Name of the stage.
+ * @return Processing function.
+ */
+function<string(string const&)> make_stage(string const& name)
+{
+    return [name](string const& x)
+    {
+        this_thread::sleep_for(30ms);
+        return name + "(" + x + ")";
+    };
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Input data.
+    vector<string> x_vec = gen_vec_string(80, "x");
+
+    // Arrival times: slow, then fast, then slow again.
+    vector<double> arrival_ms;
+    double t = 0;
+    for (size_t i=0; i<x_vec.size(); i++)
+    {
+        t += (i >= 15 && i < 65) ? 40.0 : 150.0;
+        arrival_ms.push_back(t);
+    }
+
+    ElasticPipeline pipeline({make_stage("F"), make_stage("G"), make_stage("H")},
+                             {"F", "G", "H"});
+
+    // Start timer.
+    Timer timer;
+
+    vector<string> y_vec = pipeline.run(x_vec, arrival_ms);
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+
+    // Show the decision log and metrics.
+    cout << pipeline.describe() << endl;
+    cout << "Last output: " << y_vec.back() << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,178 @@
+/******************************************************************************
+ * Example 18 shows how to checkpoint the in-flight state of the Parallel
+ * Pipeline from Example 2, and restore it after a crash so it resumes in the
+ * middle of the stream without filling the pipeline from scratch. The
+ * pipeline calculates the following mathematical expression using 3 parallel
+ * threads for the 3 functions F, G and H.
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The function H is stateful here, because it counts the items it has
+ * processed and appends the count to its output. The count is saved in the
+ * checkpoint together with F_buffer and G_buffer.
+ *
+ * The pipeline is stopped in the middle of the stream to simulate a crash,
+ * and then restored from the last checkpoint. The items processed after the
+ * checkpoint are processed again, so the output is at-least-once, and the
+ * final output is the same as for a run without the crash.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <cstdio>
+
+#include "common.hpp"
+#include "checkpoint.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Path of the checkpoint file.
+static string const checkpoint_path = "checkpoint.bin";
+
+/** Function H which counts the items it has processed. */
+class CountingH : public StatefulStage
+{
+    private:
+        // Number of items processed.
+        uint64_t count = 0;
+
+    public:
+        string operator()(string const& x) override
+        {
+            count++;
+            return H(x) + "#" + to_string(count);
+        }
+
+        string save_state() const override
+        {
+            return string((char const*) &count, sizeof(count));
+        }
+
+        void load_state(string const& state) override
+        {
+            state.copy((char*) &count, sizeof(count));
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with elements x[i] to produce
+ * H(G(F(x[i]))) where the functions F, G and H are run in parallel,
+ * with periodic checkpoints.
+ *
+ * @param x_vec Input data to be processed.
+ * @param y_vec Output data, which is written at the index of the input.
+ * @param checkpoint Checkpoint to resume from, or nullptr to start from scratch.
+ * @param crash_at Iteration where the pipeline stops, to simulate a crash.
+ */
+void parallel(vector<string> const& x_vec, vector<string>& y_vec,
+              Checkpoint const* checkpoint, uint crash_at)
+{
+    // Start timer.
+    Timer timer;
+
+    // Stateful function H.
+    CountingH H_stage;
+    auto H_func = [&H_stage](string const& x) { return H_stage(x); };
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // First iteration to be run.
+    uint i_start = 0;
+
+    // Restore the buffers and state from the checkpoint.
+    if (checkpoint != nullptr)
+    {
+        // The checkpoint may be from a pipeline with other stages.
+        if (checkpoint->buffers.size() != 2 || checkpoint->states.size() != 1)
+        {
+            throw runtime_error("Checkpoint does not match the pipeline.");
+        }
+
+        i_start = checkpoint->iteration;
+        F_buffer = checkpoint->buffers[0];
+        G_buffer = checkpoint->buffers[1];
+        H_stage.load_state(checkpoint->states[0]);
+        cout << "Resuming at iteration " << i_start << " with F_buffer: " << F_buffer
+             << "  G_buffer: " << G_buffer << endl;
+    }
+
+    // Checkpoint every 300 msec.
+    Checkpointer checkpointer(checkpoint_path, 300ms);
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=i_start; i<x_vec.size() + 2; i++)
+    {
+        if (i == crash_at)
+        {
+            cout << "Crash at iteration " << i << " after " << checkpointer.saved()
+                 << " checkpoints." << endl;
+            return;
+        }
+
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F, x_i);
+        auto G_future = async_stage(G, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        string H_result = H_future.get();
+
+        if (i >= 2)
+        {
+            y_vec[i - 2] = H_result;
+        }
+
+        // Snapshot at the iteration boundary where no stage is running.
+        if (checkpointer.due())
+        {
+            checkpointer.save({i + 1, {F_buffer, G_buffer}, {H_stage.save_state()}});
+        }
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(20, "x");
+
+    // Run without a crash for comparison.
+    vector<string> y_expected(x_vec.size(), no_data);
+    parallel(x_vec, y_expected, nullptr, -1);
+
+    // Run with a crash, and restore from the last checkpoint.
+    vector<string> y_vec(x_vec.size(), no_data);
+    parallel(x_vec, y_vec, nullptr, 12);
+    Checkpoint checkpoint = load_checkpoint(checkpoint_path);
+    parallel(x_vec, y_vec, &checkpoint, -1);
+
+    cout << "Last output: " << y_vec.back() << endl;
+    cout << "Same output as without crash: " << (y_vec == y_expected ? "Yes" : "No") << endl;
+
+    // Remove the checkpoint file.
+    remove(checkpoint_path.c_str());
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,127 @@
+/******************************************************************************
+ * Example 19 shows how to farm out a slow function G to several worker
+ * threads, and compare an in-order link to the sink with a relaxed link that
+ * passes on each item as soon as it is finished.
+ *
+ * A new item x[i] arrives every 20 msec. The function G usually takes 50 msec
+ * but sometimes 300 msec, like when there are page faults or noisy
+ * neighbours, so it is farmed out to 6 worker threads to keep up. The sink
+ * only counts the items, so it does not need them in order.
+ *
+ * With the in-order link, all the items that finish after a slow item are
+ * held back in the reorder buffer until the slow item is finished. With the
+ * relaxed link, only the slow items themselves have a high latency.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "common.hpp"
+#include "farm.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Function G that usually takes 50 msec, and 300 msec for about every 10th
+ * item. The slow items are chosen by a hash of the item, so they are the
+ * same in every run, and both links get the same slow items.
+ */
+string G_slow(string const& x)
+{
+    bool straggler = hash<string>()(x) % 10 == 0;
+    this_thread::sleep_for(straggler ? 300ms : 50ms);
+    return "G(" + x + ")";
+}
+
+/*****************************************************************************/
+
+/**
+ * Run the pipeline with the farmed function G and print the latencies.
+ *
+ * @param x_vec Input data.
+ * @param order Order of the link from G to the sink.
+ */
+void run(vector<string> const& x_vec, LinkOrder order)
+{
+    cout << ((order == LinkOrder::InOrder) ? "In-order link:" : "Relaxed link:") << endl;
+
+    // Start timer.
+    Timer timer;
+
+    Link source_link(LinkOrder::InOrder);
+    Link sink_link(order);
+    Farm farm(G_slow, 6);
+
+    // Arrival time of each item.
+    vector<chrono::steady_clock::time_point> arrival(x_vec.size());
+
+    // Source which pushes a new item every 20 msec.
+    thread source([&]
+    {
+        for (size_t i=0; i<x_vec.size(); i++)
+        {
+            arrival[i] = chrono::steady_clock::now();
+            source_link.push({i, x_vec[i]});
+            this_thread::sleep_for(20ms);
+        }
+        source_link.close();
+    });
+
+    thread farm_thread([&] { farm.run(source_link, sink_link); });
+
+    // Sink which counts the items and measures their latency.
+    vector<double> latency;
+    vector<bool> received(x_vec.size(), false);
+    Tagged item;
+    while (sink_link.pop(item))
+    {
+        chrono::duration<double, milli> dur = chrono::steady_clock::now() - arrival[item.index];
+        latency.push_back(dur.count());
+        received[item.index] = true;
+    }
+
+    source.join();
+    farm_thread.join();
+
+    sort(latency.begin(), latency.end());
+    double mean = 0;
+    for (double t : latency)
+    {
+        mean += t / latency.size();
+    }
+
+    cout << "Items: " << count(received.begin(), received.end(), true)
+         << "  Mean latency: " << mean << "ms"
+         << "  p50: " << latency[latency.size() / 2] << "ms"
+         << "  p99: " << latency[latency.size() * 99 / 100] << "ms"
+         << "  Max reorder buffer: " << sink_link.max_buffered() << endl;
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(200, "x");
+
+    run(x_vec, LinkOrder::InOrder);
+    cout << endl;
+    run(x_vec, LinkOrder::Relaxed);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
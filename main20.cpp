@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Example 20 shows how to hedge the slow calls of the pure functions F, G and
+ * H in the Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads.
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * Each function usually takes 20 msec, but a few calls take 200 msec, like
+ * when there are page faults or other programs on the same machine. Because
+ * the threads are joined after each iteration, a single slow call delays the
+ * whole iteration.
+ *
+ * The pipeline is first run as normal, and then with hedged functions, which
+ * start a duplicate call when a call is slower than the 95th percentile of
+ * the recent calls. The 99th percentile of the iteration times is compared.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+#include "common.hpp"
+#include "hedge.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Dummy pure function which usually takes 20 msec, and 200 msec for 3% of
+ * the calls. The slow calls are random, so a duplicate call is usually fast.
+ *
+ * @param name Name of the function.
+ * @return Processing function.
+ */
+function<string(string const&)> make_stage(string const& name)
+{
+    return [name](string const& x)
+    {
+        // Each worker thread gets its own seed.
+        static atomic<unsigned> seed{1};
+        thread_local mt19937 rng(seed++);
+        bool straggler = uniform_real_distribution<double>(0, 1)(rng) < 0.03;
+        this_thread::sleep_for(straggler ? 200ms : 20ms);
+        return name + "(" + x + ")";
+    };
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with elements x[i] to produce
+ * H(G(F(x[i]))) where the functions F, G and H are run in parallel.
+ * Prints the percentiles of the iteration times.
+ *
+ * @param x_vec input data to be processed.
+ * @param F_func Processing function F.
+ * @param G_func Processing function G.
+ * @param H_func Processing function H.
+ * @return Output data.
+ */
+vector<string> parallel(vector<string> const& x_vec,
+                        function<string(string const&)> F_func,
+                        function<string(string const&)> G_func,
+                        function<string(string const&)> H_func)
+{
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    vector<string> y_vec;
+    vector<double> iteration_times;
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        auto time_start = chrono::steady_clock::now();
+
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        string H_result = H_future.get();
+
+        if (!is_no_data(H_result))
+        {
+            y_vec.push_back(H_result);
+        }
+
+        chrono::duration<double, milli> dur = chrono::steady_clock::now() - time_start;
+        iteration_times.push_back(dur.count());
+    }
+
+    sort(iteration_times.begin(), iteration_times.end());
+    size_t n = iteration_times.size();
+    cout << "Iteration time p50: " << iteration_times[n / 2] << "ms"
+         << "  p99: " << iteration_times[n * 99 / 100] << "ms" << endl;
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+
+    return y_vec;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(300, "x");
+
+    cout << "Normal:" << endl;
+    vector<string> y_normal = parallel(x_vec, make_stage("F"), make_stage("G"), make_stage("H"));
+    cout << endl;
+
+    cout << "Hedged:" << endl;
+    HedgedStage F_hedged(make_stage("F"));
+    HedgedStage G_hedged(make_stage("G"));
+    HedgedStage H_hedged(make_stage("H"));
+    vector<string> y_hedged = parallel(x_vec,
+        [&](string const& x) { return F_hedged(x); },
+        [&](string const& x) { return G_hedged(x); },
+        [&](string const& x) { return H_hedged(x); });
+
+    cout << "Hedge rate  F: " << F_hedged.hedge_rate() << "  G: " << G_hedged.hedge_rate()
+         << "  H: " << H_hedged.hedge_rate() << endl;
+    cout << "Hedge wins  F: " << F_hedged.hedge_win_rate() << "  G: " << G_hedged.hedge_win_rate()
+         << "  H: " << H_hedged.hedge_win_rate() << endl;
+    cout << "Same output: " << (y_normal == y_hedged ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
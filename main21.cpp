@@ -0,0 +1,125 @@
+/******************************************************************************
+ * Example 21 shows how to export live metrics from the Parallel Pipeline in
+ * Example 2 in the text format of Prometheus. The pipeline calculates the
+ * following mathematical expression using 3 parallel threads for the 3
+ * functions F, G and H.
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The processing time of G varies, so some iterations take longer than
+ * their budget of 120 msec, which is counted as a deadline miss.
+ *
+ * The metrics are written to the file metrics.prom every 500 msec. If a port
+ * number is given on the command-line, e.g. ./main21 9464, the metrics are
+ * also served on http://localhost:9464/metrics while the pipeline runs.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <random>
+
+#include "common.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Path of the metrics file.
+static string const metrics_path = "metrics.prom";
+
+/** Function G whose processing time varies between 80 and 140 msec. */
+string G_varying(string const& x)
+{
+    static thread_local mt19937 rng(random_device{}());
+    this_thread::sleep_for(chrono::milliseconds(uniform_int_distribution<int>(80, 140)(rng)));
+    return "G(" + x + ")";
+}
+
+/*****************************************************************************/
+
+int main(int argc, char* argv[])
+{
+    // Optional port for the HTTP server.
+    uint16_t port = (argc > 1) ? stoi(argv[1]) : 0;
+
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(40, "x");
+
+    // Wrap the stages so their calls are measured.
+    MetricsRegistry registry;
+    auto F_func = registry.wrap<string>("F", F);
+    auto G_func = registry.wrap<string>("G", G_varying);
+    auto H_func = registry.wrap<string>("H", H);
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Number of items in the buffers, which is read by the exporter thread.
+    atomic<int> in_flight{0};
+    registry.add_gauge("pipeline_in_flight", "Items in the buffers between the stages.",
+                       [&] { return (double) in_flight.load(); });
+
+    // Arrival time of each item, which is the start of its iteration.
+    vector<chrono::steady_clock::time_point> arrival(x_vec.size());
+
+    // Budget for each iteration.
+    auto budget = 120ms;
+
+    // Start timer.
+    Timer timer;
+
+    {
+        MetricsExporter exporter(registry, metrics_path, 500ms, port);
+
+        // Note that we need +2 iterations because of the buffering and threading.
+        for (uint i=0; i<x_vec.size() + 2; i++)
+        {
+            auto time_start = chrono::steady_clock::now();
+
+            string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+            if (i < x_vec.size())
+            {
+                arrival[i] = time_start;
+            }
+
+            auto F_future = async_stage(F_func, x_i);
+            auto G_future = async_stage(G_func, F_buffer);
+            auto H_future = async_stage(H_func, G_buffer);
+
+            F_buffer = F_future.get();
+            G_buffer = G_future.get();
+            string H_result = H_future.get();
+
+            auto time_end = chrono::steady_clock::now();
+            in_flight = !is_no_data(F_buffer) + !is_no_data(G_buffer);
+
+            // The output of H in iteration i is for the input item i-2.
+            if (!is_no_data(H_result))
+            {
+                registry.record_item(time_end - arrival[i - 2], time_end - time_start > budget);
+            }
+        }
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl << endl;
+
+    // Show the final metrics.
+    ifstream file(metrics_path);
+    cout << file.rdbuf();
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,97 @@
+/******************************************************************************
+ * Example 22 shows how a watchdog can detect and report a stage that is stuck
+ * in the Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H.
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The function G hangs for 3 seconds on one of the input items. Without the
+ * watchdog, the pipeline would just freeze while it waits for G in the
+ * future.get() join. With the watchdog, the stall is reported a few hundred
+ * milli-sec after the call of G becomes much slower than normal, with the
+ * iteration and input it is stuck on.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+
+#include "common.hpp"
+#include "watchdog.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Function G that hangs on the input F(x_5). */
+string G_hangs(string const& x)
+{
+    if (x == "F(x_5)")
+    {
+        this_thread::sleep_for(3s);
+    }
+    return G(x);
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(10, "x");
+
+    // Timer for the time since the start, to show when the stall is reported.
+    Timer timer;
+
+    // Watchdog which reports calls taking more than 5 times the typical time.
+    // The failure policy could also e.g. raise an alarm or abort the program.
+    Watchdog watchdog(5.0, 50ms, [&timer](StallReport const& report)
+    {
+        cout << timer.elapsed() << "  " << report.describe() << endl;
+    });
+
+    auto F_func = watchdog.wrap<string>("F", F);
+    auto G_func = watchdog.wrap<string>("G", G_hangs);
+    auto H_func = watchdog.wrap<string>("H", H);
+    watchdog.start();
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        watchdog.set_iteration(i);
+
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        string H_result = H_future.get();
+
+        cout << "Step " + to_string(i) + ":  Thread 1: " << F_buffer
+             << "  Thread 2: " << G_buffer << "  Thread 3: " << H_result << endl;
+    }
+
+    cout << "Stalls detected: " << watchdog.stalls() << endl;
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * Example 23 shows how to account the CPU-time and wall-time of each stage in
+ * the Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H.
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The functions are slow for different reasons: F waits for I/O, G computes
+ * on the CPU, and H waits for a lock that is often held by another thread.
+ * All of them take about 100 msec, so the wall-time alone cannot tell them
+ * apart, but the CPU-time and context switches can.
+ *
+ * The pipeline is then run again while other threads are busy on all the
+ * CPU cores, so the stages are preempted by the OS.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "common.hpp"
+#include "accounting.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Lock which is shared with a background thread.
+static mutex shared_mutex;
+
+/** Function F that waits for I/O. */
+string F_io(string const& x)
+{
+    this_thread::sleep_for(sleep_time);
+    return "F(" + x + ")";
+}
+
+/** Function G that computes on the CPU. */
+string G_cpu(string const& x)
+{
+    double cpu_end = thread_cpu_ms() + 100.0;
+    while (thread_cpu_ms() < cpu_end) {}
+    return "G(" + x + ")";
+}
+
+/** Function H that waits for a lock which is held by another thread. */
+string H_lock(string const& x)
+{
+    lock_guard<mutex> lock(shared_mutex);
+    return "H(" + x + ")";
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with elements x[i] to produce
+ * H(G(F(x[i]))) where the functions F, G and H are run in parallel,
+ * and print the accounting of the stages.
+ *
+ * @param x_vec input data to be processed.
+ */
+void parallel(vector<string> const& x_vec)
+{
+    // Start timer.
+    Timer timer;
+
+    Accounting accounting;
+    auto F_func = accounting.wrap<string>("F", F_io);
+    auto G_func = accounting.wrap<string>("G", G_cpu);
+    auto H_func = accounting.wrap<string>("H", H_lock);
+
+    // Background thread which holds the lock most of the time.
+    atomic<bool> stop{false};
+    thread holder([&stop]
+    {
+        while (!stop)
+        {
+            {
+                lock_guard<mutex> lock(shared_mutex);
+                this_thread::sleep_for(100ms);
+            }
+            this_thread::sleep_for(1ms);
+        }
+    });
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        F_buffer = F_future.get();
+        G_buffer = G_future.get();
+        H_future.get();
+    }
+
+    stop = true;
+    holder.join();
+
+    cout << accounting.describe();
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data.
+    vector<string> x_vec = gen_vec_string(10, "x");
+
+    cout << "Idle machine:" << endl;
+    parallel(x_vec);
+    cout << endl;
+
+    // Threads that keep all the CPU cores busy.
+    atomic<bool> stop{false};
+    vector<thread> hogs;
+    for (uint c=0; c<2 * thread::hardware_concurrency(); c++)
+    {
+        hogs.emplace_back([&stop] { while (!stop) {} });
+    }
+
+    cout << "Busy machine:" << endl;
+    parallel(x_vec);
+
+    stop = true;
+    for (auto& hog : hogs)
+    {
+        hog.join();
+    }
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
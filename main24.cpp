@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Example 24 shows how to use a rope as the payload in a text-processing
+ * pipeline, instead of std::string. The pipeline is like Example 4, which
+ * calculates the following mathematical expression using 3 parallel threads
+ * for the 3 functions F, G and H.
+ *
+ *      y[i] = H(F(x[i]) + G(z[i]))
+ *
+ * Each of the functions F, G and H is a chain of 100 steps, where each step
+ * wraps its input like "f(" + x + ")", as in a tokenizer or normalizer. The
+ * inputs are long strings, so with std::string most of the time is spent
+ * copying the whole string in every step. With a rope, each step only adds a
+ * few nodes, and the text is copied once when it is flattened at the sink.
+ *
+ * There is no sleep in the functions, so the elapsed time is the real cost
+ * of the string handling. The ropes are made in a DoubleArena, so the memory
+ * for the ropes is reused for every 10 items instead of growing for the
+ * whole stream.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+
+#include "common.hpp"
+#include "rope.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Number of steps in each of the functions F, G and H.
+static int const num_steps = 100;
+
+/**
+ * Chain of steps which each wrap the input with a name. This works for both
+ * std::string and Rope.
+ *
+ * @param name Name of the steps.
+ * @param x Input text.
+ * @return Output text.
+ */
+string chain(string const& name, string const& x)
+{
+    string y = x;
+    for (int s=0; s<num_steps; s++)
+    {
+        y = name + "(" + y + ")";
+    }
+    return y;
+}
+
+Rope chain(string const& name, Rope const& x)
+{
+    Rope y = x;
+    for (int s=0; s<num_steps; s++)
+    {
+        y = y.wrap(name + "(", ")");
+    }
+    return y;
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of vectors with elements x[i] and z[i] to produce
+ * H(F(x[i]) + G(z[i])) where the functions F, G and H are run in parallel.
+ * The payload type T is either std::string or Rope.
+ *
+ * @param x_vec input data to be processed.
+ * @param z_vec input data to be processed.
+ * @param to_payload Conversion from std::string to the payload type, for
+ *                   the item with the given index.
+ * @param to_sink Conversion from the payload type to std::string at the sink.
+ * @return Output data.
+ */
+template <typename T>
+vector<string> parallel(vector<string> const& x_vec, vector<string> const& z_vec,
+                        function<T(string const&, size_t)> to_payload,
+                        function<string(T const&)> to_sink)
+{
+    // Start timer.
+    Timer timer;
+
+    auto F_func = [](T const& x) { return chain("f", x); };
+    auto G_func = [](T const& z) { return chain("g", z); };
+    auto H_func = [](T const& y) { return chain("h", y); };
+
+    // Buffered output of sums of functions F and G from previous iteration.
+    T F_G_sum_buffer = to_payload(no_data, 0);
+
+    vector<string> y_vec;
+
+    // Note that we need +1 iteration because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 1; i++)
+    {
+        T x_i = to_payload((i < x_vec.size()) ? x_vec[i] : no_data, i);
+        T z_i = to_payload((i < z_vec.size()) ? z_vec[i] : no_data, i);
+
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, z_i);
+        auto H_future = async_stage(H_func, F_G_sum_buffer);
+
+        T F_result = F_future.get();
+        T G_result = G_future.get();
+        T H_result = H_future.get();
+
+        F_G_sum_buffer = sum(F_result, G_result);
+
+        // The sink converts the output to std::string.
+        if (!is_no_data(H_result))
+        {
+            y_vec.push_back(to_sink(H_result));
+        }
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+
+    return y_vec;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vectors of long strings for the input data.
+    vector<string> x_vec = gen_vec_string(200, "x" + string(10000, '.'));
+    vector<string> z_vec = gen_vec_string(200, "z" + string(10000, '.'));
+
+    cout << "std::string:" << endl;
+    vector<string> y_string = parallel<string>(x_vec, z_vec,
+        [](string const& x, size_t) { return x; },
+        [](string const& y) { return y; });
+
+    cout << "Rope:" << endl;
+    // Each item is in the pipeline for 2 iterations, so the arena for a
+    // group of 10 items can be reset when it is used for the next group.
+    DoubleArena arenas(10);
+    vector<string> y_rope = parallel<Rope>(x_vec, z_vec,
+        [&arenas](string const& x, size_t i) { return (x == no_data) ? Rope() : Rope(arenas.for_item(i), x); },
+        [](Rope const& y) { return y.flatten(); });
+
+    cout << "Arenas: " << arenas.allocated() / 1000 << " KB" << endl;
+    cout << "Same output: " << (y_string == y_rope ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Example 25 shows how the fused serial executor runs a chain of 8 stages
+ * tile by tile on large blocks of audio samples, so each tile stays in the
+ * L1 cache while all the stages process it.
+ *
+ * First it benchmarks the fused serial executor against the naive serial
+ * loop, which runs each stage on the whole block like serial() in main2.cpp.
+ * Both copy the block once and then process it in-place, so the difference
+ * is only the cache blocking. This mainly pays when the blocks are larger
+ * than the last-level cache. On CPUs with a large L3 cache and good hardware
+ * prefetching, the two executors can be about equally fast.
+ *
+ * Then it shows how the executor is chosen automatically: The fused serial
+ * executor is used for small blocks where the threads of the Parallel
+ * Pipeline cost more than they save, and when there is only one CPU core.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "fused.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Kernel which applies a function to each sample of a tile.
+ *
+ * @param func Function applied to each sample.
+ * @return Kernel for the stage.
+ */
+template <typename Function>
+TileKernel sample_kernel(Function func)
+{
+    return [func](float* data, size_t n)
+    {
+        for (size_t i=0; i<n; i++)
+        {
+            data[i] = func(data[i]);
+        }
+    };
+}
+
+/**
+ * Generate a vector of blocks with a sine-wave.
+ *
+ * @param n Number of blocks.
+ * @param block_size Number of samples in each block.
+ * @return Vector of blocks.
+ */
+vector<Block> gen_vec_sine(size_t n, size_t block_size)
+{
+    vector<Block> vec;
+    for (size_t i=0; i<n; i++)
+    {
+        vector<float> data(block_size);
+        for (size_t j=0; j<block_size; j++)
+        {
+            data[j] = sin(0.001f * (i * block_size + j));
+        }
+        vec.push_back(make_block(move(data)));
+    }
+    return vec;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Chain of 8 cheap stages, e.g. gains, offsets and clipping.
+    StageChain chain({sample_kernel([](float x) { return 0.5f * x; }),
+                      sample_kernel([](float x) { return x + 0.1f; }),
+                      sample_kernel([](float x) { return 2.0f * x; }),
+                      sample_kernel([](float x) { return min(1.0f, max(-1.0f, x)); }),
+                      sample_kernel([](float x) { return x * x * x; }),
+                      sample_kernel([](float x) { return 0.9f * x - 0.05f; }),
+                      sample_kernel([](float x) { return x + 0.25f * x * x; }),
+                      sample_kernel([](float x) { return 0.8f * x; })});
+
+    // Large blocks of 4M samples = 16 MB, which do not fit in the caches.
+    vector<Block> large = gen_vec_sine(10, 1 << 22);
+
+    cout << "Naive serial, large blocks:" << endl;
+    Timer timer_naive;
+    vector<Block> y_naive;
+    for (auto const& x : large)
+    {
+        y_naive.push_back(chain.run_naive(x));
+    }
+    cout << timer_naive.elapsed() << endl;
+
+    cout << "Fused serial, large blocks:" << endl;
+    Timer timer_fused;
+    vector<Block> y_fused;
+    for (auto const& x : large)
+    {
+        y_fused.push_back(chain.run_fused(x));
+    }
+    cout << timer_fused.elapsed() << endl;
+
+    bool same = true;
+    for (size_t i=0; i<large.size(); i++)
+    {
+        same = same && (y_naive[i].data == y_fused[i].data);
+    }
+    cout << "Same output: " << (same ? "Yes" : "No") << endl << endl;
+
+    // Automatic choice of executor.
+    vector<Block> small = gen_vec_sine(1000, 64);
+
+    chain.process(small);
+    cout << "Small blocks: " << chain.chosen() << endl;
+
+    chain.process(large);
+    cout << "Large blocks: " << chain.chosen() << endl;
+
+    chain.process(large, 1);
+    cout << "Large blocks on 1 core: " << chain.chosen() << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Example 26 shows how to run a chain of image filters on video frames as a
+ * Parallel Pipeline over stripes of rows, instead of whole frames. The chain
+ * is the following, where x[i] is the frame with index i:
+ *
+ *      y[i] = color(sharpen(blur(x[i])))
+ *
+ * The frames are processed serially, then pipelined over whole frames like
+ * the items in main2.cpp, and finally pipelined over stripes of 16 rows. The
+ * mean latency per frame is compared, and the output is checked to be the
+ * same for all three.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "common.hpp"
+#include "frame.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Generate a vector of frames with a moving colour pattern.
+ *
+ * @param n Number of frames.
+ * @param width Width of each frame.
+ * @param height Height of each frame.
+ * @return Vector of frames.
+ */
+vector<Frame> gen_vec_frame(size_t n, size_t width, size_t height)
+{
+    vector<Frame> vec;
+    for (size_t i=0; i<n; i++)
+    {
+        Frame frame = make_frame(width, height);
+        for (size_t y=0; y<height; y++)
+        {
+            float* row = frame.row(y);
+            for (size_t x=0; x<width; x++)
+            {
+                row[x * 3 + 0] = 0.5f + 0.5f * sin(0.01f * (x + 10 * i));
+                row[x * 3 + 1] = 0.5f + 0.5f * sin(0.02f * y);
+                row[x * 3 + 2] = ((x / 64 + y / 64) % 2) ? 1.0f : 0.0f;
+            }
+        }
+        vec.push_back(move(frame));
+    }
+    return vec;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Full HD frames.
+    vector<Frame> frames = gen_vec_frame(8, 1920, 1080);
+
+    // Warm colour grading.
+    array<float, 9> warm = {1.1f, 0.1f, 0.0f,
+                            0.0f, 1.0f, 0.0f,
+                            0.0f, 0.1f, 0.8f};
+
+    FramePipeline pipeline({blur_stage(), sharpen_stage(), color_stage(warm)}, 16);
+
+    cout << "Serial:" << endl;
+    Timer timer_serial;
+    vector<Frame> y_serial = pipeline.serial(frames);
+    cout << timer_serial.elapsed() << "  Mean latency: " << pipeline.latency() << "ms" << endl;
+
+    cout << "Parallel over whole frames:" << endl;
+    Timer timer_frames;
+    vector<Frame> y_frames = pipeline.parallel_frames(frames);
+    cout << timer_frames.elapsed() << "  Mean latency: " << pipeline.latency() << "ms" << endl;
+
+    cout << "Parallel over stripes:" << endl;
+    Timer timer_stripes;
+    vector<Frame> y_stripes = pipeline.parallel_stripes(frames);
+    cout << timer_stripes.elapsed() << "  Mean latency: " << pipeline.latency() << "ms" << endl;
+
+    bool same = true;
+    for (size_t i=0; i<frames.size(); i++)
+    {
+        same = same && y_serial[i].pixels == y_frames[i].pixels &&
+               y_serial[i].pixels == y_stripes[i].pixels;
+    }
+    cout << "Same output: " << (same ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,142 @@
+/******************************************************************************
+ * Example 27 shows how to run audio stages that need samples after their
+ * current block as a Parallel Pipeline. The chain is the following, where
+ * x[i] is the block of samples with index i:
+ *
+ *      y[i] = gain(smooth(limit(x[i])))
+ *
+ * The limiter looks 48 samples ahead so it can lower the gain before a peak
+ * arrives, and the smoothing filter is a moving average over the current
+ * sample and the next 32 samples. The gain stage has no lookahead.
+ *
+ * The pipeline prints the delay of each stage and the total latency which
+ * includes the lookahead, and a dry signal that is mixed with the output in
+ * real-time must be delayed by this latency. The output is checked to be the
+ * same as when the stages are run serially on the whole signal.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "lookahead.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Limiter which lowers the gain so no sample within the lookahead is above
+ * the threshold.
+ */
+LookaheadStage limit_stage(size_t lookahead, float threshold)
+{
+    auto process = [lookahead, threshold](float const* in, float* out, size_t n)
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            float peak = 0.0f;
+            for (size_t s=0; s<=lookahead; s++)
+            {
+                peak = max(peak, fabs(in[t + s]));
+            }
+            out[t] = (peak > threshold) ? in[t] * threshold / peak : in[t];
+        }
+    };
+
+    return {"limit", lookahead, process};
+}
+
+/** Moving average over the current sample and the lookahead. */
+LookaheadStage smooth_stage(size_t lookahead)
+{
+    auto process = [lookahead](float const* in, float* out, size_t n)
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            float sum = 0.0f;
+            for (size_t s=0; s<=lookahead; s++)
+            {
+                sum += in[t + s];
+            }
+            out[t] = sum / (lookahead + 1);
+        }
+    };
+
+    return {"smooth", lookahead, process};
+}
+
+/** Constant gain without lookahead. */
+LookaheadStage gain_stage(float gain)
+{
+    auto process = [gain](float const* in, float* out, size_t n)
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            out[t] = gain * in[t];
+        }
+    };
+
+    return {"gain", 0, process};
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    size_t block_size = 64;
+    size_t num_blocks = 200;
+
+    // Sine wave with loud bursts.
+    vector<float> x(block_size * num_blocks);
+    for (size_t t=0; t<x.size(); t++)
+    {
+        float loud = ((t / 1000) % 3 == 0) ? 2.0f : 0.5f;
+        x[t] = loud * sin(0.05f * t);
+    }
+
+    vector<Block> x_vec;
+    for (size_t i=0; i<num_blocks; i++)
+    {
+        x_vec.push_back(make_block(vector<float>(x.begin() + i * block_size, x.begin() + (i + 1) * block_size)));
+    }
+
+    LookaheadPipeline pipeline({limit_stage(48, 1.0f), smooth_stage(32), gain_stage(0.8f)}, block_size);
+    cout << pipeline.describe() << endl;
+
+    cout << "Serial:" << endl;
+    Timer timer_serial;
+    vector<float> y_serial = pipeline.serial(x);
+    cout << timer_serial.elapsed() << endl;
+
+    cout << "Parallel:" << endl;
+    Timer timer_parallel;
+    vector<Block> y_vec = pipeline.parallel(x_vec);
+    cout << timer_parallel.elapsed() << endl;
+
+    bool same = y_vec.size() == num_blocks;
+    float peak = 0.0f;
+    for (size_t i=0; same && i<num_blocks; i++)
+    {
+        for (size_t s=0; s<block_size; s++)
+        {
+            same = same && y_vec[i].at(s) == y_serial[i * block_size + s];
+            peak = max(peak, fabs(y_vec[i].at(s)));
+        }
+    }
+    cout << "Same output: " << (same ? "Yes" : "No") << endl;
+    cout << "Output peak: " << peak << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
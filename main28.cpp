@@ -0,0 +1,173 @@
+/******************************************************************************
+ * Example 28 shows how to use a pool of buffers backed by huge pages for a
+ * Parallel Pipeline with large blocks. Each block is a frame of 2048 x 1024
+ * floats, which is 8 MB, and the chain is the following:
+ *
+ *      y[i] = H(G(F(i)))
+ *
+ * F makes frame i, G transposes the frame, and H transposes it back while
+ * scaling it. The transposes read with a stride of a whole row, so each read
+ * is on a different 4 KB page, which causes many TLB misses.
+ *
+ * The pipeline is run with new memory for each block, like the vector in a
+ * Block, then with a pool of normal pages, and finally with a pool of huge
+ * pages. The pools are pre-faulted so even the first iteration is fast.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <functional>
+
+#include "common.hpp"
+#include "hugepage.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Size of a frame.
+size_t const width = 2048;
+size_t const height = 1024;
+
+/** F: Make frame i. */
+void gen_frame(size_t i, float* out)
+{
+    for (size_t y=0; y<height; y++)
+    {
+        for (size_t x=0; x<width; x++)
+        {
+            out[y * width + x] = (float) ((x + y + i) % 256);
+        }
+    }
+}
+
+/** Transpose a frame with the given number of rows and columns. */
+void transpose(float const* in, float* out, size_t rows, size_t cols, float scale)
+{
+    for (size_t c=0; c<cols; c++)
+    {
+        for (size_t r=0; r<rows; r++)
+        {
+            out[c * rows + r] = scale * in[r * cols + c];
+        }
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel Pipeline like parallel() in main2.cpp, where the buffers for the
+ * output of the stages are acquired and released with the given functions.
+ *
+ * @param n Number of frames.
+ * @param acquire Function that returns a new buffer for a frame.
+ * @param release Function that frees a buffer.
+ * @return Checksum of the output frames.
+ */
+double parallel(size_t n, function<float*()> acquire, function<void(float*)> release)
+{
+    size_t K = 3;
+    vector<float*> buffers(K, nullptr);
+    double checksum = 0;
+    double first_ms = 0;
+    Timer timer;
+
+    for (size_t i=0; i<n + K - 1; i++)
+    {
+        auto time_start = chrono::steady_clock::now();
+
+        // Bubbles while filling and draining the pipeline have no buffer.
+        vector<float*> outputs(K, nullptr);
+        vector<future<void>> futures;
+        for (size_t k=0; k<K; k++)
+        {
+            if (i < k || i - k >= n)
+            {
+                continue;
+            }
+
+            float const* in = (k == 0) ? nullptr : buffers[k - 1];
+            float* out = outputs[k] = acquire();
+
+            futures.push_back(async(launch::async, [k, i, in, out]
+            {
+                if (k == 0) gen_frame(i, out);
+                else if (k == 1) transpose(in, out, height, width, 1.0f);
+                else transpose(in, out, width, height, 0.5f);
+            }));
+        }
+
+        for (auto& future : futures)
+        {
+            future.get();
+        }
+
+        // Sink of the pipeline.
+        if (outputs[K - 1] != nullptr)
+        {
+            for (size_t s=0; s<width * height; s+=997)
+            {
+                checksum += outputs[K - 1][s];
+            }
+            release(outputs[K - 1]);
+            outputs[K - 1] = nullptr;
+        }
+
+        // The inputs of this iteration are no longer needed.
+        for (size_t k=0; k<K; k++)
+        {
+            release(buffers[k]);
+        }
+        buffers = outputs;
+
+        if (i == 0)
+        {
+            first_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - time_start).count();
+        }
+    }
+
+    cout << "First iteration: " << first_ms << "ms" << endl;
+    cout << timer.elapsed() << endl;
+    return checksum;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    size_t n = 32;
+    size_t frame_size = width * height;
+
+    // Each of the 3 stages has its buffer from the previous iteration
+    // and a new buffer for its output.
+    size_t num_buffers = 6;
+
+    cout << "New memory for each block:" << endl;
+    double sum_new = parallel(n, [frame_size] { return new float[frame_size]; },
+                              [](float* buffer) { delete[] buffer; });
+
+    cout << "Pool with normal pages:" << endl;
+    BufferPool pool_normal(num_buffers, frame_size, PageMode::Normal);
+    double sum_normal = parallel(n, [&] { return pool_normal.acquire(); },
+                                 [&](float* buffer) { pool_normal.release(buffer); });
+
+    cout << "Pool with huge pages:" << endl;
+    BufferPool pool_huge(num_buffers, frame_size);
+    cout << pool_huge.describe() << ", " << anon_huge_kb() / 1024 << " MB of transparent huge pages in use" << endl;
+    double sum_huge = parallel(n, [&] { return pool_huge.acquire(); },
+                               [&](float* buffer) { pool_huge.release(buffer); });
+
+    cout << "Same output: " << ((sum_new == sum_normal && sum_new == sum_huge) ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
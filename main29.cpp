@@ -0,0 +1,138 @@
+/******************************************************************************
+ * Example 29 shows how to prepare a Parallel Pipeline for real-time use, so
+ * there are no memory allocations or page faults in the audio callback or
+ * the stages. The chain is the following, where x[i] is the block of audio
+ * samples with index i:
+ *
+ *      y[i] = clip(lowpass(gain(x[i])))
+ *
+ * The pipeline preallocates all its buffers, pre-faults the stacks of its
+ * threads, and locks them in RAM. It is then called by the fake audio device
+ * from host.hpp, and the number of missed callbacks is printed. This defines
+ * REALTIME_CHECK_ALLOC, so when it is compiled without NDEBUG, an assertion
+ * fails if any stage allocates memory.
+ * The output is checked to be the same as when the stages are run serially.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "host.hpp"
+
+// Check that the stages do not allocate memory, when NDEBUG is not defined.
+#define REALTIME_CHECK_ALLOC
+#include "realtime.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Make the processing stages. They are made again for the serial reference,
+ * because the lowpass filter has state.
+ */
+vector<RealtimeStage> make_stages()
+{
+    // Gain.
+    auto gain = [](float const* in, float* out, size_t n)
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            out[t] = 1.5f * in[t];
+        }
+    };
+
+    // One-pole lowpass filter, whose state is kept between the blocks.
+    auto lowpass = [state = 0.0f](float const* in, float* out, size_t n) mutable
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            state += 0.1f * (in[t] - state);
+            out[t] = state;
+        }
+    };
+
+    // Soft clipping, which is made heavier by repeating it.
+    auto clip = [](float const* in, float* out, size_t n)
+    {
+        for (size_t t=0; t<n; t++)
+        {
+            float y = in[t];
+            for (int r=0; r<20; r++)
+            {
+                y = tanh(y);
+            }
+            out[t] = y;
+        }
+    };
+
+    return {gain, lowpass, clip};
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    int block_size = 256;
+    int sample_rate = 48000;
+    long num_periods = 400;
+
+    RealtimeOptions options;
+    options.lock_memory = true;
+    RealtimePipeline pipeline(make_stages(), block_size, options);
+    cout << "Memory locked: " << (pipeline.locked() ? "Yes" : "No") << endl;
+
+    // The recorded input and output are allocated before the device runs.
+    vector<float> x_rec(block_size * num_periods);
+    vector<float> y_rec(block_size * num_periods);
+    long num_calls = 0;
+
+    auto callback = [&](float const* in, float* out, int n)
+    {
+        pipeline.process(in, out, n);
+        copy(in, in + n, x_rec.begin() + num_calls * n);
+        copy(out, out + n, y_rec.begin() + num_calls * n);
+        num_calls++;
+    };
+
+    FakeDevice device(block_size, sample_rate);
+    device.run(callback, num_periods);
+    cout << "Callbacks: " << num_calls << ", missed: " << device.missed() << endl;
+    cout << "Max callback: " << device.max_callback() << "ms" << endl;
+    cout << "Latency: " << pipeline.latency() << " samples" << endl;
+
+    // Serial reference for the recorded input.
+    vector<RealtimeStage> stages = make_stages();
+    vector<float> y_serial(block_size * num_calls);
+    vector<float> tmp(block_size);
+    for (long i=0; i<num_calls; i++)
+    {
+        float* y = y_serial.data() + i * block_size;
+        copy(x_rec.begin() + i * block_size, x_rec.begin() + (i + 1) * block_size, y);
+        for (auto& stage : stages)
+        {
+            stage(y, tmp.data(), block_size);
+            copy(tmp.begin(), tmp.end(), y);
+        }
+    }
+
+    // The output of the pipeline is delayed by its latency.
+    size_t latency = pipeline.latency();
+    bool same = true;
+    for (size_t t=0; t + latency<y_serial.size(); t++)
+    {
+        same = same && y_rec[t + latency] == y_serial[t];
+    }
+    cout << "Same output: " << (same ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -87,11 +87,11 @@ void parallel(vector<string> const& x_vec)
         string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
 
         // Async execution of function F using the current input x_i.
-        auto F_future = async(F, x_i);
+        auto F_future = async_stage(F, x_i);
 
         // Async execution of function G using the buffered output of the
         // function F from the previous iteration i-1.
-        auto G_future = async(G, F_buffer);
+        auto G_future = async_stage(G, F_buffer);
 
         // Wait for the functions to finish processing and get the results.
         string F_result = F_future.get();
@@ -90,14 +90,14 @@ void parallel(vector<string> const& x_vec, vector<string> const& z_vec)
         string z_i = (i < z_vec.size()) ? z_vec[i] : no_data;
 
         // Async execution of function F using the current input x_i.
-        auto F_future = async(F, x_i);
+        auto F_future = async_stage(F, x_i);
 
         // Async execution of function G using the current input z_i.
-        auto G_future = async(G, z_i);
+        auto G_future = async_stage(G, z_i);
 
         // Async execution of function H using the sum of buffered output
         // of the functions F and G from the previous iteration i-1.
-        auto H_future = async(H, F_G_sum_buffer);
+        auto H_future = async_stage(H, F_G_sum_buffer);
 
         // Wait for the functions to finish processing and get the results.
         string F_result = F_future.get();
@@ -0,0 +1,212 @@
+/******************************************************************************
+ * Example 5 shows how to process several short streams back-to-back in the
+ * Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H. The input for iteration i of stream s is denoted x_s[i] and the
+ * output is y_s[i].
+ *
+ *      y_s[i] = H(G(F(x_s[i])))
+ *
+ * If each stream is processed separately, then the pipeline must be filled
+ * at the start of each stream and drained at the end of each stream, which
+ * costs 2 extra iterations per stream. For short streams this is a large part
+ * of the total time.
+ *
+ * Instead, the streams can be fed into the pipeline back-to-back, so the
+ * pipeline is only filled once at the start and drained once at the end. The
+ * draining of one stream then happens in parallel with the filling of the
+ * next stream, so only 2 extra iterations are needed in total.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of several streams with elements x_s[i] to produce
+ * H(G(F(x_s[i]))) where the functions F, G and H are run in parallel, and
+ * each stream is filled into and drained from the pipeline separately.
+ *
+ * @param streams input data to be processed.
+ */
+void parallel_separate(vector<vector<string>> const& streams)
+{
+    cout << "Parallel (separate streams):" << endl;
+
+    // Start timer.
+    Timer timer;
+
+    // Step counter across all the streams.
+    uint step = 0;
+
+    // For each stream.
+    for (uint s=0; s<streams.size(); s++)
+    {
+        // Input data for stream s.
+        vector<string> const& x_vec = streams[s];
+
+        // Buffered output of functions F and G from the previous iteration.
+        // These are empty at the start of each stream.
+        string F_buffer(no_data);
+        string G_buffer(no_data);
+
+        // For each element in the input vector.
+        // Note that we need +2 iterations because of the buffering and
+        // threading, and this is needed for every stream.
+        for (uint i=0; i<x_vec.size() + 2; i++, step++)
+        {
+            // Input string for index i. Or empty string beyond the end.
+            string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+            // Async execution of the functions F, G and H.
+            auto F_future = async_stage(F, x_i);
+            auto G_future = async_stage(G, F_buffer);
+            auto H_future = async_stage(H, G_buffer);
+
+            // Wait for the functions to finish processing and get the results.
+            string F_result = F_future.get();
+            string G_result = G_future.get();
+            string H_result = H_future.get();
+
+            // Save the output of the functions F and G for use as input in the
+            // next iteration of the for-loop.
+            F_buffer = F_result;
+            G_buffer = G_result;
+
+            // Show result.
+            cout << "Step " + to_string(step) + ":  Thread 1: " << F_result
+                 << "  Thread 2: " << G_result << "  Thread 3: " << H_result
+                 << endl;
+        }
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of several streams with elements x_s[i] to produce
+ * H(G(F(x_s[i]))) where the functions F, G and H are run in parallel, and
+ * the streams are fed back-to-back into the pipeline, so the draining of one
+ * stream overlaps with the filling of the next stream.
+ *
+ * @param streams input data to be processed.
+ */
+void parallel_overlap(vector<vector<string>> const& streams)
+{
+    cout << "Parallel (overlapped streams):" << endl;
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of functions F and G from the previous iteration.
+    // These are only empty at the start of the first stream.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // Stream-index for the data in the buffers F_buffer and G_buffer, so the
+    // output of the function H can be attributed to the correct stream.
+    int F_stream = -1;
+    int G_stream = -1;
+
+    // Total number of elements in all the streams.
+    uint n = 0;
+    for (auto const& x_vec : streams)
+    {
+        n += x_vec.size();
+    }
+
+    // Stream-index and element-index for the next input.
+    uint s = 0;
+    uint j = 0;
+
+    // For each element in all the input streams.
+    // Note that we only need +2 iterations in total for all the streams.
+    for (uint i=0; i<n + 2; i++)
+    {
+        // Skip streams that have been fully fed into the pipeline.
+        while (s < streams.size() && j >= streams[s].size())
+        {
+            s++;
+            j = 0;
+        }
+
+        // Input string and its stream-index. Or empty string beyond the end.
+        string x_i = (s < streams.size()) ? streams[s][j++] : no_data;
+        int x_stream = (s < streams.size()) ? (int) s : -1;
+
+        // Async execution of the functions F, G and H.
+        auto F_future = async_stage(F, x_i);
+        auto G_future = async_stage(G, F_buffer);
+        auto H_future = async_stage(H, G_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        string F_result = F_future.get();
+        string G_result = G_future.get();
+        string H_result = H_future.get();
+
+        // Stream-index for the output of the function H.
+        int H_stream = G_stream;
+
+        // Save the output of the functions F and G and their stream-indices
+        // for use as input in the next iteration of the for-loop.
+        F_buffer = F_result;
+        G_buffer = G_result;
+        G_stream = F_stream;
+        F_stream = x_stream;
+
+        // Show result.
+        cout << "Step " + to_string(i) + ":  Thread 1: " << F_result
+             << "  Thread 2: " << G_result << "  Thread 3: " << H_result;
+
+        // Show which stream the output belongs to.
+        if (H_stream >= 0)
+        {
+            cout << "  (Stream " << H_stream << ")";
+        }
+
+        cout << endl;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate several short streams of strings for the input data.
+    vector<vector<string>> streams;
+    streams.push_back(gen_vec_string(3, "a"));
+    streams.push_back(gen_vec_string(3, "b"));
+    streams.push_back(gen_vec_string(3, "c"));
+
+    // Parallel processing with each stream filled and drained separately.
+    parallel_separate(streams);
+
+    // Show newline.
+    cout << endl;
+
+    // Parallel processing with the streams overlapped back-to-back.
+    parallel_overlap(streams);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,140 @@
+/******************************************************************************
+ * Example 6 shows how to use memoization caches for the pure functions in the
+ * Parallel Pipeline from Example 2, which calculates the following
+ * mathematical expression using 3 parallel threads for the 3 functions F, G
+ * and H. The input for iteration i is denoted x[i] and the output is y[i].
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The input stream contains blocks that are repeated, which is common in e.g.
+ * audio with silence or repeated loops. Each of the functions F, G and H is
+ * wrapped in its own StageCache, so repeated inputs are looked up in the
+ * cache instead of being calculated again.
+ *
+ * This introduces 2 extra iterations of latency, as in Example 2.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <functional>
+
+#include "common.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with elements x[i] to produce H(G(F(x[i])))
+ * where the functions F, G and H are run in parallel, and their results may
+ * be looked up in memoization caches.
+ *
+ * @param x_vec input data to be processed.
+ * @param use_cache whether to use memoization caches for F, G and H.
+ */
+void parallel(vector<string> const& x_vec, bool use_cache)
+{
+    cout << (use_cache ? "Parallel (cached):" : "Parallel:") << endl;
+
+    // Start timer.
+    Timer timer;
+
+    // Memoization caches for each of the functions F, G and H.
+    // These only have room for the 3 blocks in the repeated loop, so the new
+    // block at the end of the stream causes an eviction.
+    StageCache F_cache(F, 3);
+    StageCache G_cache(G, 3);
+    StageCache H_cache(H, 3);
+
+    // Processing functions which are either cached or not.
+    function<string(string const&)> F_func = F;
+    function<string(string const&)> G_func = G;
+    function<string(string const&)> H_func = H;
+
+    if (use_cache)
+    {
+        F_func = ref(F_cache);
+        G_func = ref(G_cache);
+        H_func = ref(H_cache);
+    }
+
+    // Buffered output of functions F and G from the previous iteration.
+    string F_buffer(no_data);
+    string G_buffer(no_data);
+
+    // For each element in the input vector.
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        // Input string for index i. Or empty string if we are beyond the end.
+        string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+        // Async execution of the functions F, G and H. The caches are only
+        // used by one thread in each iteration, so they need no locks.
+        auto F_future = async_stage(F_func, x_i);
+        auto G_future = async_stage(G_func, F_buffer);
+        auto H_future = async_stage(H_func, G_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        string F_result = F_future.get();
+        string G_result = G_future.get();
+        string H_result = H_future.get();
+
+        // Save the output of the functions F and G for use as input in the
+        // next iteration of the for-loop.
+        F_buffer = F_result;
+        G_buffer = G_result;
+
+        // Show result.
+        cout << "Step " + to_string(i) + ":  Thread 1: " << F_result
+             << "  Thread 2: " << G_result << "  Thread 3: " << H_result << endl;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+
+    // Show the cache statistics.
+    if (use_cache)
+    {
+        cout << "Cache F: " << F_cache.stats() << endl;
+        cout << "Cache G: " << G_cache.stats() << endl;
+        cout << "Cache H: " << H_cache.stats() << endl;
+    }
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vector of strings for the input data, where a short loop of
+    // 3 blocks is repeated several times, and a new block occurs at the end.
+    vector<string> loop = gen_vec_string(3, "x");
+    vector<string> x_vec;
+    for (int i=0; i<9; i++)
+    {
+        x_vec.push_back(loop[i % loop.size()]);
+    }
+    x_vec.push_back("x_3");
+
+    // Parallel processing without caches.
+    parallel(x_vec, false);
+
+    // Show newline.
+    cout << endl;
+
+    // Parallel processing with caches.
+    parallel(x_vec, true);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
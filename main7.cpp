@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Example 7 shows how constant blocks such as digital silence are propagated
+ * through the Parallel Pipeline from Example 4, which calculates the
+ * following mathematical expression using 3 parallel threads for the 3
+ * functions F, G and H. There are two streams of input blocks and for
+ * iteration i they are denoted x[i] and z[i], and the output is y[i].
+ *
+ *      y[i] = H(F(x[i]) + G(z[i]))
+ *
+ * The functions F, G and H are applied to each sample independently, so they
+ * declare how they map a constant input to a constant output. When an input
+ * block is silent, it is flagged as constant at the source of the stream,
+ * and the flag then flows through F, G, the sum and H, which all process the
+ * constant block in O(1) time instead of processing all of its samples.
+ *
+ * This introduces 1 extra iteration of latency, as in Example 4.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <cmath>
+
+#include "common.hpp"
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Number of samples in each block.
+static size_t const block_size = 64;
+
+// Processing stages which all declare a constant-map.
+static Stage const F_stage = make_sample_stage([](float x) { return 0.5f * x; });
+static Stage const G_stage = make_sample_stage([](float x) { return 2.0f * x; });
+static Stage const H_stage = make_sample_stage([](float x) { return tanh(x); });
+
+// Processing functions used in the pipeline.
+Block F_block(Block const& x) { return F_stage(x); }
+Block G_block(Block const& x) { return G_stage(x); }
+Block H_block(Block const& x) { return H_stage(x); }
+
+/*****************************************************************************/
+
+/**
+ * Generate a vector of blocks where the blocks with index in [begin, end)
+ * are digital silence and the other blocks contain a sine-wave.
+ *
+ * @param n Number of blocks.
+ * @param begin First index of the silent blocks.
+ * @param end Index after the last silent block.
+ * @return Vector of blocks.
+ */
+vector<Block> gen_vec_block(int n, int begin, int end)
+{
+    vector<Block> vec;
+
+    for (int i=0; i<n; i++)
+    {
+        vector<float> data(block_size, 0.0f);
+
+        if (i < begin || i >= end)
+        {
+            for (size_t j=0; j<block_size; j++)
+            {
+                data[j] = sin(0.1f * (i * block_size + j));
+            }
+        }
+
+        Block block = make_block(move(data));
+
+        // Flag silent blocks as constant once at the source of the stream.
+        detect_constant(block);
+
+        vec.push_back(block);
+    }
+
+    return vec;
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of vectors with blocks x[i] and z[i] to produce
+ * H(F(x[i]) + G(z[i])) where the functions F, G and H are run in parallel.
+ *
+ * @param x_vec input data to be processed.
+ * @param z_vec input data to be processed.
+ */
+void parallel(vector<Block> const& x_vec, vector<Block> const& z_vec)
+{
+    cout << "Parallel:" << endl;
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of sums of functions F and G from previous iteration.
+    Block F_G_sum_buffer;
+
+    // For each element in the input vector.
+    // Note that we need +1 iteration because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 1; i++)
+    {
+        // Input blocks for index i. Or empty blocks if we are beyond the end.
+        Block x_i = (i < x_vec.size()) ? x_vec[i] : Block();
+        Block z_i = (i < z_vec.size()) ? z_vec[i] : Block();
+
+        // Async execution of the functions F, G and H. Constant blocks are
+        // processed in O(1) time by the stages.
+        auto F_future = async_stage(F_block, x_i);
+        auto G_future = async_stage(G_block, z_i);
+        auto H_future = async_stage(H_block, F_G_sum_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        Block F_result = F_future.get();
+        Block G_result = G_future.get();
+        Block H_result = H_future.get();
+
+        // Save the sum of the output of the functions F and G for use as input
+        // to the function H in the next iteration of the for-loop. The sum of
+        // two constant blocks is also a constant block.
+        F_G_sum_buffer = sum(F_result, G_result);
+
+        // Show result.
+        cout << "Step " + to_string(i) + ":  Thread 1: " << to_string(F_result)
+             << "  Thread 2: " << to_string(G_result)
+             << "  Thread 3: " << to_string(H_result) << endl;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Generate vectors of blocks for the input data, where both streams are
+    // silent in the middle and the x-stream is also silent at the end.
+    vector<Block> x_vec = gen_vec_block(10, 3, 10);
+    vector<Block> z_vec = gen_vec_block(10, 2, 7);
+
+    // Parallel processing of all the vector elements.
+    parallel(x_vec, z_vec);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
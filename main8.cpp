@@ -0,0 +1,135 @@
+/******************************************************************************
+ * Example 8 shows how to make a multi-rate Parallel Pipeline where the stages
+ * use different block sizes and sample rates. The chain of stages is:
+ *
+ *      Gain with 64-sample blocks.
+ *      FFT-filter with 1024-sample blocks.
+ *      Decimator by 2 with 128-sample input blocks and 64-sample output blocks.
+ *      EQ with 64-sample blocks at the decimated sample rate.
+ *
+ * The stages are connected by links that rebuffer the samples. Each iteration
+ * processes a hyper-block of 1024 input samples, so the Gain stage is called
+ * 16 times per iteration, the FFT-filter once, the Decimator 8 times, and the
+ * EQ 8 times. The dummy stages sleep so that each of them takes 100 msec per
+ * iteration in total, so the pipeline is balanced.
+ *
+ * This introduces 3 extra iterations of latency, which is verified by finding
+ * the position of an impulse in the output of the serial and parallel runs.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "multirate.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Create a dummy stage that simulates heavy processing by sleeping for the
+ * given time on each call, and copies every step'th input sample.
+ *
+ * @param name Name of the stage.
+ * @param block_in Number of input samples for each call.
+ * @param step Decimation factor, which is 1 for no decimation.
+ * @param sleep Sleep-time for each call.
+ * @return Processing stage.
+ */
+RateStage make_dummy_stage(string name, size_t block_in, size_t step,
+                           chrono::microseconds sleep)
+{
+    auto process = [step, sleep](Block const& x)
+    {
+        // Simulate heavy processing.
+        this_thread::sleep_for(sleep);
+
+        vector<float> data;
+        for (size_t i=0; i<x.size; i+=step)
+        {
+            data.push_back(x.at(i));
+        }
+
+        return make_block(move(data));
+    };
+
+    return RateStage{name, block_in, block_in / step, process};
+}
+
+/*****************************************************************************/
+
+/**
+ * Find the index of the first sample that is not zero.
+ *
+ * @param y Samples.
+ * @return Index of the impulse.
+ */
+size_t find_impulse(vector<float> const& y)
+{
+    return find_if(y.begin(), y.end(), [](float v) { return v != 0.0f; }) - y.begin();
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Each stage takes 100 msec per iteration in total.
+    auto const t = chrono::duration_cast<chrono::microseconds>(sleep_time);
+
+    // Multi-rate chain of stages.
+    MultiRatePipeline pipeline({
+        make_dummy_stage("Gain", 64, 1, t / 16),
+        make_dummy_stage("FFT", 1024, 1, t),
+        make_dummy_stage("Decim", 128, 2, t / 8),
+        make_dummy_stage("EQ", 64, 1, t / 8)
+    });
+
+    // Show the schedule of the pipeline.
+    cout << "Hyper-block: " << pipeline.hyper_block() << " input samples" << endl;
+    cout << "Output rate: " << pipeline.output_rate() << endl;
+    cout << "Pipeline delay: " << pipeline.pipeline_delay() << " input samples" << endl;
+    cout << "Latency: " << pipeline.latency() << " input samples" << endl;
+    cout << endl;
+
+    // Input signal with an impulse at an even index so it survives decimation.
+    vector<float> x(10 * 1024, 0.0f);
+    size_t impulse = 1000;
+    x[impulse] = 1.0f;
+
+    // Serial processing.
+    cout << "Serial:" << endl;
+    Timer timer_serial;
+    vector<float> y_serial = pipeline.serial(x);
+    cout << timer_serial.elapsed() << endl;
+    cout << endl;
+
+    // Parallel processing.
+    cout << "Parallel:" << endl;
+    Timer timer_parallel;
+    vector<float> y_parallel = pipeline.parallel(x, true);
+    cout << timer_parallel.elapsed() << endl;
+    cout << endl;
+
+    // Measure the delay of the impulse in input samples.
+    double delay = (find_impulse(y_parallel) - find_impulse(y_serial)) / pipeline.output_rate();
+    cout << "Measured pipeline delay: " << delay << " input samples" << endl;
+
+    // The delay is a whole number of input samples.
+    bool same = llround(delay) == (long long) pipeline.pipeline_delay();
+    cout << "Same delay as computed: " << (same ? "Yes" : "No") << endl;
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
@@ -0,0 +1,237 @@
+/******************************************************************************
+ * Example 9 shows how to use partitioned FFT convolution as a heavy and
+ * realistic workload in the Parallel Pipeline from Example 2, which
+ * calculates the following mathematical expression using 3 parallel threads
+ * for the 3 functions F, G and H. The input for iteration i is denoted x[i]
+ * and the output is y[i].
+ *
+ *      y[i] = H(G(F(x[i])))
+ *
+ * The functions F, G and H are convolutions with long impulse responses,
+ * e.g. reverbs in audio processing. The example first checks that the
+ * partitioned FFT convolution gives the same result as direct convolution,
+ * and then measures the time for the serial and parallel processing. It also
+ * shows how the partitions of each convolution can be pipelined across even
+ * more cores, by calculating their tails in advance in other threads.
+ *
+ * This introduces 2 extra iterations of latency, as in Example 2.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <functional>
+
+#include "common.hpp"
+#include "block.hpp"
+#include "convolution.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Number of samples in each block.
+static size_t const block_size = 1024;
+
+// Number of samples in each impulse response, which is 5 seconds at 48 kHz.
+static size_t const ir_size = 5 * 48000;
+
+/*****************************************************************************/
+
+/**
+ * Generate random samples e.g. for an input signal or impulse response,
+ * which decay exponentially with the given time-constant.
+ *
+ * @param n Number of samples.
+ * @param decay Time-constant in samples, or 0 for no decay.
+ * @param seed Seed for the random number generator.
+ * @return Vector of samples.
+ */
+vector<float> gen_random(size_t n, double decay, unsigned seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    vector<float> x(n);
+    for (size_t i=0; i<n; i++)
+    {
+        x[i] = dist(rng) * (decay > 0 ? exp(-i / decay) : 1.0);
+    }
+
+    return x;
+}
+
+/*****************************************************************************/
+
+/**
+ * Check that the partitioned FFT convolution gives the same result as direct
+ * convolution, both when the tail is calculated in the same thread and when
+ * it is calculated in advance in other threads.
+ */
+void check()
+{
+    size_t n_blocks = 8;
+    size_t b = 64;
+    vector<float> x = gen_random(n_blocks * b, 0, 1);
+    vector<float> h = gen_random(5 * b + 17, 0, 2);
+
+    // Direct convolution.
+    vector<float> y_direct(x.size(), 0.0f);
+    for (size_t i=0; i<x.size(); i++)
+    {
+        for (size_t j=0; j<h.size() && j<=i; j++)
+        {
+            y_direct[i] += h[j] * x[i - j];
+        }
+    }
+
+    for (size_t num_threads : {0, 2})
+    {
+        ConvolutionStage conv(h, b, num_threads);
+
+        double max_error = 0;
+        for (size_t k=0; k<n_blocks; k++)
+        {
+            vector<float> x_k(x.begin() + k * b, x.begin() + (k + 1) * b);
+            Block y_k = conv(make_block(x_k));
+
+            for (size_t i=0; i<b; i++)
+            {
+                max_error = max(max_error, (double) fabs(y_k.at(i) - y_direct[k * b + i]));
+            }
+        }
+
+        cout << "Max error with " << num_threads << " tail-threads: " << max_error << endl;
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * Serial processing of a vector with blocks x[i] to produce H(G(F(x[i])))
+ * where the convolutions F, G and H are run in serial.
+ *
+ * @param x_vec input data to be processed.
+ * @param num_tail_threads Threads for the tail of each convolution.
+ */
+void serial(vector<Block> const& x_vec, size_t num_tail_threads)
+{
+    cout << "Serial (" << num_tail_threads << " tail-threads per stage):" << endl;
+
+    // Convolutions with different impulse responses.
+    ConvolutionStage F(gen_random(ir_size, 48000, 3), block_size, num_tail_threads);
+    ConvolutionStage G(gen_random(ir_size, 48000, 4), block_size, num_tail_threads);
+    ConvolutionStage H(gen_random(ir_size, 48000, 5), block_size, num_tail_threads);
+
+    // Start timer.
+    Timer timer;
+
+    // For each element in the input vector.
+    for (uint i=0; i<x_vec.size(); i++)
+    {
+        Block y_i = H(G(F(x_vec[i])));
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+/**
+ * Parallel processing of a vector with blocks x[i] to produce H(G(F(x[i])))
+ * where the convolutions F, G and H are run in parallel.
+ *
+ * @param x_vec input data to be processed.
+ * @param num_tail_threads Threads for the tail of each convolution.
+ */
+void parallel(vector<Block> const& x_vec, size_t num_tail_threads)
+{
+    cout << "Parallel (" << num_tail_threads << " tail-threads per stage):" << endl;
+
+    // Convolutions with different impulse responses.
+    ConvolutionStage F(gen_random(ir_size, 48000, 3), block_size, num_tail_threads);
+    ConvolutionStage G(gen_random(ir_size, 48000, 4), block_size, num_tail_threads);
+    ConvolutionStage H(gen_random(ir_size, 48000, 5), block_size, num_tail_threads);
+
+    // Start timer.
+    Timer timer;
+
+    // Buffered output of functions F and G from the previous iteration.
+    Block F_buffer;
+    Block G_buffer;
+
+    // For each element in the input vector.
+    // Note that we need +2 iterations because of the buffering and threading.
+    for (uint i=0; i<x_vec.size() + 2; i++)
+    {
+        // Input block for index i. Or empty block if we are beyond the end.
+        Block x_i = (i < x_vec.size()) ? x_vec[i] : Block();
+
+        // Async execution of the functions F, G and H. The convolutions have
+        // state so they are passed by reference.
+        auto F_future = async_stage(ref(F), x_i);
+        auto G_future = async_stage(ref(G), F_buffer);
+        auto H_future = async_stage(ref(H), G_buffer);
+
+        // Wait for the functions to finish processing and get the results.
+        Block F_result = F_future.get();
+        Block G_result = G_future.get();
+        Block H_result = H_future.get();
+
+        // Save the output of the functions F and G for use as input in the
+        // next iteration of the for-loop.
+        F_buffer = F_result;
+        G_buffer = G_result;
+    }
+
+    // Show the elapsed time.
+    cout << timer.elapsed() << endl;
+}
+
+/*****************************************************************************/
+
+int main()
+{
+    // Check the convolution is correct.
+    check();
+
+    // Show newline.
+    cout << endl;
+
+    // Generate vector of blocks for the input data.
+    vector<float> x = gen_random(200 * block_size, 0, 6);
+    vector<Block> x_vec;
+    for (size_t i=0; i<x.size(); i+=block_size)
+    {
+        x_vec.push_back(make_block(vector<float>(x.begin() + i, x.begin() + i + block_size)));
+    }
+
+    cout << "Partitions per convolution: " << (ir_size + block_size - 1) / block_size << endl;
+    cout << endl;
+
+    // Serial processing of all the vector elements.
+    serial(x_vec, 0);
+    cout << endl;
+
+    // Parallel processing of all the vector elements.
+    parallel(x_vec, 0);
+    cout << endl;
+
+    // Parallel processing with the tail of each convolution calculated in
+    // advance in other threads.
+    parallel(x_vec, 2);
+
+    // No error.
+    return 0;
+}
+
+/*****************************************************************************/
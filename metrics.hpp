@@ -0,0 +1,469 @@
+/******************************************************************************
+ * Live metrics for a Parallel Pipeline in the text format of Prometheus, so a
+ * pipeline running in production can be monitored without a debugger.
+ *
+ * The stages are wrapped so each call updates the counters and histogram of
+ * its stage, using relaxed atomic operations without any locks. Only the
+ * thread running a stage writes to its counters, so there is no contention,
+ * and the overhead is a few atomic additions per call. The pipeline also
+ * reports the latency and deadline misses of its items, and gauges such as
+ * queue depths are read from callbacks when the metrics are rendered.
+ *
+ * The exporter renders the metrics in a background thread at regular
+ * intervals, and rewrites a text file that can be read by the textfile
+ * collector of the Prometheus node exporter. It can also serve the metrics
+ * on a local HTTP port, which Prometheus can scrape directly.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Upper bounds in seconds of the buckets for the histograms.
+static array<double, 12> const histogram_bounds =
+    {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 2.0, 5.0};
+
+/** Histogram of durations, which is updated without locks. */
+struct Histogram
+{
+    // Number of observations in each bucket, plus one for larger values.
+    array<atomic<uint64_t>, histogram_bounds.size() + 1> buckets{};
+
+    // Sum of the observations in nano-sec.
+    atomic<uint64_t> sum_ns{0};
+
+    /** Add an observation. */
+    void observe(chrono::nanoseconds dur)
+    {
+        double seconds = dur.count() * 1e-9;
+        size_t b = 0;
+        while (b < histogram_bounds.size() && seconds > histogram_bounds[b])
+        {
+            b++;
+        }
+        buckets[b].fetch_add(1, memory_order_relaxed);
+        sum_ns.fetch_add(dur.count(), memory_order_relaxed);
+    }
+
+    /**
+     * Render the histogram in the Prometheus text format.
+     *
+     * @param name Name of the metric.
+     * @param labels Labels, e.g. stage="F", or empty.
+     */
+    string render(string const& name, string const& labels) const
+    {
+        string sep = labels.empty() ? "" : ",";
+        ostringstream out;
+        uint64_t count = 0;
+        for (size_t b=0; b<buckets.size(); b++)
+        {
+            count += buckets[b].load(memory_order_relaxed);
+            string le = (b < histogram_bounds.size()) ? to_string(histogram_bounds[b]) : "+Inf";
+            out << name << "_bucket{" << labels << sep << "le=\"" << le << "\"} " << count << "\n";
+        }
+        string braces = labels.empty() ? "" : "{" + labels + "}";
+        out << name << "_sum" << braces << " " << sum_ns.load(memory_order_relaxed) * 1e-9 << "\n";
+        out << name << "_count" << braces << " " << count << "\n";
+        return out.str();
+    }
+};
+
+/** Metrics of a single stage, which are only written by its own thread. */
+struct StageMetrics
+{
+    // Name of the stage.
+    string name;
+
+    // Number of calls that are not bubbles.
+    atomic<uint64_t> calls{0};
+
+    // Time in nano-sec the stage has been busy.
+    atomic<uint64_t> busy_ns{0};
+
+    // Durations of the calls.
+    Histogram durations;
+};
+
+/*****************************************************************************/
+
+/** Registry of the metrics for a pipeline. */
+class MetricsRegistry
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Metrics of each stage. These are pointers so they never move.
+        vector<unique_ptr<StageMetrics>> stages;
+
+        // Gauges read from callbacks when rendering.
+        vector<tuple<string, string, function<double()>>> gauges;
+
+        // Items finished by the pipeline, their latency and deadline misses.
+        atomic<uint64_t> items{0};
+        atomic<uint64_t> misses{0};
+        Histogram latency;
+
+        // Values at the last rendering, for the utilization and throughput.
+        // They are kept for renderings less than 100 msec apart, so the rates
+        // are not measured over very short intervals.
+        mutex render_mutex;
+        clock_type::time_point time_last;
+        uint64_t items_last = 0;
+        vector<uint64_t> busy_last;
+
+    public:
+        MetricsRegistry() : time_last(clock_type::now()) {}
+
+        /**
+         * Wrap a processing stage so its calls are measured. All stages must
+         * be wrapped before the pipeline starts. The registry must outlive the
+         * wrapped stages.
+         *
+         * @param name Name of the stage.
+         * @param func Processing function of the stage.
+         * @return Processing function that updates the metrics.
+         */
+        template <typename T>
+        function<T(T const&)> wrap(string const& name, function<T(T const&)> func)
+        {
+            stages.emplace_back(new StageMetrics());
+            StageMetrics* m = stages.back().get();
+            m->name = name;
+            busy_last.push_back(0);
+
+            return [m, func](T const& x)
+            {
+                auto time_start = clock_type::now();
+                T y = func(x);
+                auto dur = chrono::duration_cast<chrono::nanoseconds>(clock_type::now() - time_start);
+
+                m->calls.fetch_add(1, memory_order_relaxed);
+                m->busy_ns.fetch_add(dur.count(), memory_order_relaxed);
+                m->durations.observe(dur);
+
+                return y;
+            };
+        }
+
+        /**
+         * Add a gauge which is read when the metrics are rendered, e.g. the
+         * depth of a queue. The callback must be thread-safe.
+         *
+         * @param name Name of the metric.
+         * @param help Description of the metric.
+         * @param read Callback that reads the current value.
+         */
+        void add_gauge(string const& name, string const& help, function<double()> read)
+        {
+            gauges.emplace_back(name, help, read);
+        }
+
+        /**
+         * Record an item that has passed through the whole pipeline.
+         *
+         * @param item_latency Time from the arrival of the item to its output.
+         * @param missed Whether the item missed its deadline.
+         */
+        void record_item(chrono::nanoseconds item_latency, bool missed)
+        {
+            items.fetch_add(1, memory_order_relaxed);
+            misses.fetch_add(missed, memory_order_relaxed);
+            latency.observe(item_latency);
+        }
+
+        /**
+         * Render all the metrics in the Prometheus text format. The
+         * utilization and throughput are measured since the last rendering
+         * that was at least 100 msec ago.
+         */
+        string render()
+        {
+            lock_guard<mutex> lock(render_mutex);
+
+            auto now = clock_type::now();
+            double interval = chrono::duration<double>(now - time_last).count();
+            bool new_baseline = interval >= 0.1;
+            if (new_baseline)
+            {
+                time_last = now;
+            }
+
+            ostringstream out;
+
+            uint64_t items_now = items.load(memory_order_relaxed);
+            out << "# HELP pipeline_items_total Items processed by the whole pipeline.\n"
+                << "# TYPE pipeline_items_total counter\n"
+                << "pipeline_items_total " << items_now << "\n";
+            out << "# HELP pipeline_throughput Items per second since the last update.\n"
+                << "# TYPE pipeline_throughput gauge\n"
+                << "pipeline_throughput " << (items_now - items_last) / interval << "\n";
+            if (new_baseline)
+            {
+                items_last = items_now;
+            }
+
+            out << "# HELP pipeline_deadline_misses_total Items that missed their deadline.\n"
+                << "# TYPE pipeline_deadline_misses_total counter\n"
+                << "pipeline_deadline_misses_total " << misses.load(memory_order_relaxed) << "\n";
+
+            out << "# HELP pipeline_latency_seconds Latency from arrival to output of each item.\n"
+                << "# TYPE pipeline_latency_seconds histogram\n"
+                << latency.render("pipeline_latency_seconds", "");
+
+            out << "# HELP pipeline_stage_calls_total Calls of each stage, excluding bubbles.\n"
+                << "# TYPE pipeline_stage_calls_total counter\n";
+            for (auto const& m : stages)
+            {
+                out << "pipeline_stage_calls_total{stage=\"" << m->name << "\"} "
+                    << m->calls.load(memory_order_relaxed) << "\n";
+            }
+
+            out << "# HELP pipeline_stage_utilization Fraction of time each stage was busy since the last update.\n"
+                << "# TYPE pipeline_stage_utilization gauge\n";
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                uint64_t busy_now = stages[k]->busy_ns.load(memory_order_relaxed);
+                out << "pipeline_stage_utilization{stage=\"" << stages[k]->name << "\"} "
+                    << (busy_now - busy_last[k]) * 1e-9 / interval << "\n";
+                if (new_baseline)
+                {
+                    busy_last[k] = busy_now;
+                }
+            }
+
+            out << "# HELP pipeline_stage_duration_seconds Duration of the calls of each stage.\n"
+                << "# TYPE pipeline_stage_duration_seconds histogram\n";
+            for (auto const& m : stages)
+            {
+                out << m->durations.render("pipeline_stage_duration_seconds",
+                                           "stage=\"" + m->name + "\"");
+            }
+
+            for (auto const& g : gauges)
+            {
+                out << "# HELP " << get<0>(g) << " " << get<1>(g) << "\n"
+                    << "# TYPE " << get<0>(g) << " gauge\n"
+                    << get<0>(g) << " " << get<2>(g)() << "\n";
+            }
+
+            return out.str();
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Exporter which renders the metrics in a background thread, and rewrites a
+ * text file and optionally serves them on a local HTTP port.
+ */
+class MetricsExporter
+{
+    private:
+        // Registry with the metrics.
+        MetricsRegistry& registry;
+
+        // Path of the text file.
+        string path;
+
+        // Time between the updates.
+        chrono::milliseconds interval;
+
+        // Socket for the HTTP server, or -1 if not used.
+        int server_fd = -1;
+
+        // Latest rendering of the metrics, which is served over HTTP.
+        mutex text_mutex;
+        string text;
+
+        // Whether the threads should stop.
+        atomic<bool> stop{false};
+        mutex stop_mutex;
+        condition_variable stop_cv;
+
+        // Background threads.
+        thread writer;
+        thread server;
+
+        /** Render the metrics and rewrite the text file. */
+        void update()
+        {
+            string rendered = registry.render();
+
+            {
+                lock_guard<mutex> lock(text_mutex);
+                text = rendered;
+            }
+
+            // Write to a temporary file and rename it, so a reader never sees
+            // a half-written file.
+            string tmp_path = path + ".tmp";
+            {
+                ofstream file(tmp_path);
+                file << rendered;
+            }
+            rename(tmp_path.c_str(), path.c_str());
+        }
+
+        /** Main loop for the writer thread. */
+        void run_writer()
+        {
+            unique_lock<mutex> lock(stop_mutex);
+            while (!stop_cv.wait_for(lock, interval, [this] { return stop.load(); }))
+            {
+                lock.unlock();
+                update();
+                lock.lock();
+            }
+        }
+
+        /** Main loop for the HTTP server, which answers every request with the metrics. */
+        void run_server()
+        {
+            while (!stop)
+            {
+                // Poll with a timeout so the thread notices when to stop.
+                pollfd pfd{server_fd, POLLIN, 0};
+                if (poll(&pfd, 1, 100) <= 0)
+                {
+                    continue;
+                }
+
+                int client_fd = accept(server_fd, nullptr, nullptr);
+                if (client_fd < 0)
+                {
+                    continue;
+                }
+
+                // Timeouts so a client that sends or reads nothing cannot block
+                // the later scrapes or the shutdown. The socket is then closed.
+                timeval timeout{0, 500 * 1000};
+                setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+                // The request itself is ignored, but must be read before replying.
+                char request[1024];
+                if (read(client_fd, request, sizeof(request)) >= 0)
+                {
+                    string body;
+                    {
+                        lock_guard<mutex> lock(text_mutex);
+                        body = text;
+                    }
+
+                    string response = "HTTP/1.0 200 OK\r\n"
+                                      "Content-Type: text/plain; version=0.0.4\r\n"
+                                      "Content-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+
+                    size_t sent = 0;
+                    while (sent < response.size())
+                    {
+                        ssize_t n = write(client_fd, response.data() + sent, response.size() - sent);
+                        if (n <= 0) break;
+                        sent += n;
+                    }
+                }
+
+                close(client_fd);
+            }
+        }
+
+    public:
+        /**
+         * Start the exporter.
+         *
+         * @param registry Registry with the metrics, which must outlive the exporter.
+         * @param path Path of the text file.
+         * @param interval Time between the updates.
+         * @param port Local HTTP port for the metrics, or 0 for no HTTP server.
+         */
+        MetricsExporter(MetricsRegistry& registry, string const& path,
+                        chrono::milliseconds interval, uint16_t port = 0)
+            : registry(registry), path(path), interval(interval)
+        {
+            if (port > 0)
+            {
+                server_fd = socket(AF_INET, SOCK_STREAM, 0);
+                int reuse = 1;
+                setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+                // Only bind to localhost, so the metrics are not exposed to the network.
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+                if (server_fd < 0 || ::bind(server_fd, (sockaddr*) &addr, sizeof(addr)) != 0 ||
+                    listen(server_fd, 8) != 0)
+                {
+                    if (server_fd >= 0) close(server_fd);
+                    throw runtime_error("Cannot listen on port " + to_string(port));
+                }
+            }
+
+            update();
+            writer = thread(&MetricsExporter::run_writer, this);
+
+            if (server_fd >= 0)
+            {
+                server = thread(&MetricsExporter::run_server, this);
+            }
+        }
+
+        MetricsExporter(MetricsExporter const&) = delete;
+        MetricsExporter& operator=(MetricsExporter const&) = delete;
+
+        /** Stop the threads and write the final metrics. */
+        ~MetricsExporter()
+        {
+            {
+                lock_guard<mutex> lock(stop_mutex);
+                stop = true;
+            }
+            stop_cv.notify_all();
+
+            writer.join();
+            if (server.joinable())
+            {
+                server.join();
+                close(server_fd);
+            }
+
+            update();
+        }
+};
+
+/*****************************************************************************/
+
+#endif
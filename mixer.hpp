@@ -0,0 +1,404 @@
+/******************************************************************************
+ * Hybrid scheduler for mixer graphs, where many independent tracks each have
+ * a serial chain of effects like in main2.cpp, and the outputs of the tracks
+ * are summed into a bus like in main4.cpp.
+ *
+ * There are two kinds of parallelism in such a graph. The independent tracks
+ * can run as parallel tasks without any extra latency. But the time for each
+ * block can never be less than the longest chain of effects on a single
+ * track, which is the critical path. Only the chains on the critical path are
+ * therefore split into segments that run as a Parallel Pipeline, which costs
+ * 1 block of latency for each extra segment. The other tracks are delayed to
+ * match, so all tracks are still aligned when they are summed into the bus.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef MIXER_HPP
+#define MIXER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Processing function in the effect chain of a track. */
+using Effect = function<string(string const&)>;
+
+/**
+ * Track in a mixer graph, with a serial chain of effects and the measured
+ * processing time in milli-sec for each effect.
+ */
+struct Track
+{
+    // Name of the track for printing.
+    string name;
+
+    // Chain of effects in the order they are applied.
+    vector<Effect> effects;
+
+    // Measured processing time in milli-sec for each effect.
+    vector<double> costs;
+};
+
+/*****************************************************************************/
+
+/**
+ * Measure the processing time of each effect in a track by calling it once.
+ *
+ * @param track Track whose costs are measured.
+ * @param x Input string used for the measurement.
+ */
+void measure(Track& track, string const& x)
+{
+    track.costs.clear();
+
+    for (auto const& effect : track.effects)
+    {
+        auto time_start = chrono::steady_clock::now();
+        effect(x);
+        chrono::duration<double, milli> dur = chrono::steady_clock::now() - time_start;
+        track.costs.push_back(dur.count());
+    }
+}
+
+/*****************************************************************************/
+
+/**
+ * Split a chain of costs into the given number of contiguous segments, so the
+ * largest segment cost is minimized. This is found by trying all split-points
+ * with dynamic programming, which is fast for the short chains on a track.
+ *
+ * @param costs Cost of each effect in the chain.
+ * @param num_segments Number of segments.
+ * @return Index of the first effect in each segment.
+ */
+vector<size_t> split_chain(vector<double> const& costs, size_t num_segments)
+{
+    size_t n = costs.size();
+    num_segments = min(num_segments, n);
+
+    // Cumulative sum of the costs.
+    vector<double> cum(n + 1, 0.0);
+    partial_sum(costs.begin(), costs.end(), cum.begin() + 1);
+
+    // best[s][i] is the smallest max segment cost for the first i effects
+    // split into s segments, and first[s][i] is where the last segment starts.
+    double const inf = 1e300;
+    vector<vector<double>> best(num_segments + 1, vector<double>(n + 1, inf));
+    vector<vector<size_t>> first(num_segments + 1, vector<size_t>(n + 1, 0));
+    best[0][0] = 0.0;
+
+    for (size_t s=1; s<=num_segments; s++)
+    {
+        for (size_t i=s; i<=n; i++)
+        {
+            for (size_t j=s-1; j<i; j++)
+            {
+                double cost = max(best[s - 1][j], cum[i] - cum[j]);
+                if (cost < best[s][i])
+                {
+                    best[s][i] = cost;
+                    first[s][i] = j;
+                }
+            }
+        }
+    }
+
+    // Backtrack the split-points.
+    vector<size_t> starts(num_segments);
+    size_t i = n;
+    for (size_t s=num_segments; s>=1; s--)
+    {
+        starts[s - 1] = first[s][i];
+        i = first[s][i];
+    }
+
+    return starts;
+}
+
+/*****************************************************************************/
+
+/**
+ * Mixer that runs a number of tracks and sums them into a bus, using a fixed
+ * number of worker threads. The plan for how many pipeline segments to use
+ * for each track is made from the measured costs of the effects.
+ */
+class Mixer
+{
+    private:
+        // Tracks in the mixer.
+        vector<Track> tracks;
+
+        // Number of worker threads.
+        size_t num_workers;
+
+        // Index of the first effect in each pipeline segment of each track.
+        vector<vector<size_t>> segments;
+
+        /** Cost of the largest pipeline segment of track t. */
+        double critical_cost(size_t t) const
+        {
+            auto const& starts = segments[t];
+            auto const& costs = tracks[t].costs;
+            double max_cost = 0;
+
+            for (size_t s=0; s<starts.size(); s++)
+            {
+                size_t end = (s + 1 < starts.size()) ? starts[s + 1] : costs.size();
+                max_cost = max(max_cost, accumulate(costs.begin() + starts[s], costs.begin() + end, 0.0));
+            }
+
+            return max_cost;
+        }
+
+        /** Apply effects with index in [begin, end) of track t in serial. */
+        string run_segment(size_t t, size_t begin, size_t end, string x) const
+        {
+            for (size_t e=begin; e<end; e++)
+            {
+                x = tracks[t].effects[e](x);
+            }
+            return x;
+        }
+
+    public:
+        /**
+         * Create a mixer. The costs of the effects must have been measured.
+         *
+         * @param tracks Tracks in the mixer.
+         * @param num_workers Number of worker threads, e.g. number of cores.
+         */
+        Mixer(vector<Track> const& tracks, size_t num_workers)
+            : tracks(tracks), num_workers(max((size_t) 1, num_workers)),
+              segments(tracks.size(), vector<size_t>{0}) {}
+
+        /**
+         * Plan how many pipeline segments to use for each track. Tracks are
+         * only pipelined while the critical path is longer than the total
+         * work divided by the number of workers, because then the workers
+         * would otherwise be idle while waiting for the critical path.
+         * A margin of 5% is used so that small errors in the measured costs
+         * do not cause extra pipeline segments and latency.
+         *
+         * @param max_latency Max number of blocks of added latency.
+         * @return Planned time in milli-sec for processing each block.
+         */
+        double plan(size_t max_latency)
+        {
+            // Start without any pipelining.
+            for (auto& s : segments)
+            {
+                s = {0};
+            }
+
+            if (tracks.empty())
+            {
+                return 0.0;
+            }
+
+            // Lower bound for the time when all workers are busy.
+            double total = 0;
+            for (auto const& track : tracks)
+            {
+                total += accumulate(track.costs.begin(), track.costs.end(), 0.0);
+            }
+            double bound = total / num_workers;
+
+            // Margin for errors in the measured costs.
+            double const margin = 1.05;
+
+            while (true)
+            {
+                // Track on the critical path.
+                size_t t_max = 0;
+                for (size_t t=1; t<tracks.size(); t++)
+                {
+                    if (critical_cost(t) > critical_cost(t_max))
+                    {
+                        t_max = t;
+                    }
+                }
+
+                double critical = critical_cost(t_max);
+                size_t num_segments = segments[t_max].size();
+
+                // Stop when the workers can be kept busy, or when the track
+                // cannot be split further, or the latency would be too high.
+                if (critical <= bound * margin ||
+                    num_segments >= tracks[t_max].effects.size() ||
+                    num_segments > max_latency)
+                {
+                    return max(critical, bound);
+                }
+
+                // Split the track on the critical path into one more segment.
+                auto old_segments = segments[t_max];
+                segments[t_max] = split_chain(tracks[t_max].costs, num_segments + 1);
+
+                // Stop if this did not shorten the critical path.
+                if (critical_cost(t_max) * margin >= critical)
+                {
+                    segments[t_max] = old_segments;
+                    return max(critical, bound);
+                }
+            }
+        }
+
+        /** Number of blocks of latency, which is the deepest pipeline. */
+        size_t latency() const
+        {
+            size_t depth = 0;
+            for (auto const& s : segments)
+            {
+                depth = max(depth, s.size() - 1);
+            }
+            return depth;
+        }
+
+        /** Description of the plan for printing. */
+        string describe() const
+        {
+            string desc;
+            for (size_t t=0; t<tracks.size(); t++)
+            {
+                desc += tracks[t].name + ": " + to_string(segments[t].size()) +
+                        " segment(s), critical " + to_string(critical_cost(t)) + "ms\n";
+            }
+            desc += "Latency: " + to_string(latency()) + " block(s)";
+            return desc;
+        }
+
+        /**
+         * Process a stream of blocks. Every track gets the same input block,
+         * and the outputs of the tracks are summed into the bus.
+         *
+         * @param x_vec Input blocks.
+         * @return Output blocks of the bus.
+         */
+        vector<string> process(vector<string> const& x_vec) const
+        {
+            size_t T = tracks.size();
+            size_t depth = latency();
+
+            // Buffered output of each pipeline segment of each track from the
+            // previous iteration, like F_buffer and G_buffer in main2.cpp.
+            vector<vector<string>> buffers(T);
+            for (size_t t=0; t<T; t++)
+            {
+                buffers[t].assign(segments[t].size(), no_data);
+            }
+
+            // Delay-lines that compensate for the tracks being pipelined with
+            // fewer segments than the deepest track, so they are aligned.
+            vector<deque<string>> delays(T);
+            for (size_t t=0; t<T; t++)
+            {
+                delays[t].assign(depth - (segments[t].size() - 1), no_data);
+            }
+
+            // Tasks for a single iteration, which are the pipeline segments.
+            struct Task
+            {
+                size_t t;
+                size_t s;
+                double cost;
+            };
+
+            vector<Task> tasks;
+            for (size_t t=0; t<T; t++)
+            {
+                for (size_t s=0; s<segments[t].size(); s++)
+                {
+                    size_t end = (s + 1 < segments[t].size()) ? segments[t][s + 1] : tracks[t].effects.size();
+                    double cost = accumulate(tracks[t].costs.begin() + segments[t][s],
+                                             tracks[t].costs.begin() + end, 0.0);
+                    tasks.push_back({t, s, cost});
+                }
+            }
+
+            // Start the most expensive tasks first for better load-balancing.
+            sort(tasks.begin(), tasks.end(), [](Task const& a, Task const& b) { return a.cost > b.cost; });
+
+            vector<string> y_vec;
+
+            // Note that we need +depth iterations because of the buffering.
+            for (size_t i=0; i<x_vec.size() + depth; i++)
+            {
+                string x_i = (i < x_vec.size()) ? x_vec[i] : no_data;
+
+                // Output of each task in this iteration.
+                vector<vector<string>> results(T);
+                for (size_t t=0; t<T; t++)
+                {
+                    results[t].assign(segments[t].size(), no_data);
+                }
+
+                // Worker threads that take tasks from the list until it is empty.
+                atomic<size_t> next{0};
+                auto worker = [&]()
+                {
+                    for (size_t j=next++; j<tasks.size(); j=next++)
+                    {
+                        Task const& task = tasks[j];
+                        auto const& starts = segments[task.t];
+                        size_t begin = starts[task.s];
+                        size_t end = (task.s + 1 < starts.size()) ? starts[task.s + 1] : tracks[task.t].effects.size();
+
+                        // Input is either the new block or the buffered output
+                        // of the previous segment from the previous iteration.
+                        string const& x = (task.s == 0) ? x_i : buffers[task.t][task.s - 1];
+                        results[task.t][task.s] = (x == no_data) ? no_data : run_segment(task.t, begin, end, x);
+                    }
+                };
+
+                vector<future<void>> futures;
+                for (size_t w=0; w<num_workers; w++)
+                {
+                    futures.push_back(async(launch::async, worker));
+                }
+                for (auto& f : futures)
+                {
+                    f.get();
+                }
+
+                // Save the buffers for the next iteration, delay the output
+                // of each track to align them, and sum them into the bus.
+                string bus = no_data;
+                for (size_t t=0; t<T; t++)
+                {
+                    buffers[t] = results[t];
+                    delays[t].push_back(results[t].back());
+                    string y_t = delays[t].front();
+                    delays[t].pop_front();
+
+                    bus = (bus == no_data) ? y_t : sum(bus, y_t);
+                }
+
+                // The first iterations only fill the pipelines.
+                if (i >= depth)
+                {
+                    y_vec.push_back(bus);
+                }
+            }
+
+            return y_vec;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,381 @@
+/******************************************************************************
+ * Multi-rate Parallel Pipelines where the stages may use different block
+ * sizes and sample rates, e.g. effects with 64-sample blocks, FFT stages with
+ * 1024-sample blocks, and decimators that halve the sample rate.
+ *
+ * The stages are connected by links that rebuffer the samples between the
+ * block sizes. Each iteration of the pipeline processes a "hyper-block" of
+ * input samples, which is the smallest number of input samples so that every
+ * stage processes a whole number of its own blocks in each iteration. So all
+ * stages are busy in every iteration, and the latency is exactly known.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef MULTIRATE_HPP
+#define MULTIRATE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include <functional>
+
+#include "common.hpp"
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Processing stage for a multi-rate pipeline, which takes blocks with a fixed
+ * number of input samples and produces blocks with a fixed number of output
+ * samples. E.g. a decimator by 2 with 128 input samples has 64 output samples.
+ */
+struct RateStage
+{
+    // Name of the stage for printing.
+    string name;
+
+    // Number of input samples for each call of the processing function.
+    size_t block_in;
+
+    // Number of output samples for each call of the processing function.
+    size_t block_out;
+
+    // Processing function.
+    function<Block(Block const&)> process;
+};
+
+/*****************************************************************************/
+
+/**
+ * Link between two stages, which buffers the output samples of one stage
+ * until there are enough samples for a block of the next stage.
+ */
+class Rebuffer
+{
+    private:
+        // Buffered samples.
+        deque<float> samples;
+
+    public:
+        /** Append all the samples of a block to the buffer. */
+        void push(Block const& block)
+        {
+            for (size_t i=0; i<block.size; i++)
+            {
+                samples.push_back(block.at(i));
+            }
+        }
+
+        /** Number of buffered samples. */
+        size_t size() const
+        {
+            return samples.size();
+        }
+
+        /**
+         * Remove a block of samples from the front of the buffer.
+         *
+         * @param n Number of samples. Must be no more than size().
+         * @return Block of samples.
+         */
+        Block pop(size_t n)
+        {
+            vector<float> data(samples.begin(), samples.begin() + n);
+            samples.erase(samples.begin(), samples.begin() + n);
+            return make_block(move(data));
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Parallel Pipeline for a chain of stages with different block sizes and
+ * sample rates, which calculates y = S_K(...S_2(S_1(x))) for K stages.
+ *
+ * Each stage runs in its own thread. In each iteration, stage k processes
+ * the hyper-block that stage k-1 produced in the previous iteration, just
+ * like F_buffer and G_buffer in main2.cpp. The only difference is that a
+ * stage may call its processing function several times per iteration, if
+ * its block size is smaller than its share of the hyper-block.
+ */
+class MultiRatePipeline
+{
+    private:
+        // Processing stages.
+        vector<RateStage> stages;
+
+        // Sample rate at the input of each stage relative to the pipeline's
+        // input sample rate, as a fraction rate_num[k] / rate_den[k].
+        vector<size_t> rate_num;
+        vector<size_t> rate_den;
+
+        // Number of input samples to the pipeline in each iteration.
+        size_t hyper_size;
+
+        /**
+         * Number of samples at the input of stage k in each iteration.
+         * Use k equal to the number of stages for the pipeline's output.
+         */
+        size_t samples_per_iteration(size_t k) const
+        {
+            return hyper_size * rate_num[k] / rate_den[k];
+        }
+
+        /** Process several blocks in the same thread and concatenate them. */
+        static Block process_blocks(RateStage const& stage,
+                                    vector<Block> const& blocks)
+        {
+            Rebuffer out;
+            for (auto const& block : blocks)
+            {
+                out.push(stage.process(block));
+            }
+            return out.pop(out.size());
+        }
+
+    public:
+        /**
+         * Create a multi-rate pipeline and calculate its hyper-block size.
+         *
+         * @param stages Processing stages in the order they are applied.
+         */
+        MultiRatePipeline(vector<RateStage> const& stages) : stages(stages)
+        {
+            if (stages.empty())
+            {
+                throw invalid_argument("MultiRatePipeline needs a stage.");
+            }
+
+            // Relative sample rate at the input of the first stage.
+            rate_num.push_back(1);
+            rate_den.push_back(1);
+
+            // The hyper-block must give a whole number of blocks to each stage.
+            hyper_size = 1;
+
+            for (auto const& stage : stages)
+            {
+                size_t num = rate_num.back();
+                size_t den = rate_den.back();
+
+                if (stage.block_in == 0 || stage.block_out == 0)
+                {
+                    throw invalid_argument("Block size must be positive: " + stage.name);
+                }
+
+                // Stage needs hyper_size * num / den to be a multiple of
+                // block_in, so hyper_size must be a multiple of this.
+                size_t multiple = den * stage.block_in / gcd(num, den * stage.block_in);
+                hyper_size = lcm(hyper_size, multiple);
+
+                // Relative sample rate at the output of this stage.
+                num *= stage.block_out;
+                den *= stage.block_in;
+                size_t g = gcd(num, den);
+                rate_num.push_back(num / g);
+                rate_den.push_back(den / g);
+            }
+        }
+
+        /** Number of input samples processed in each iteration. */
+        size_t hyper_block() const
+        {
+            return hyper_size;
+        }
+
+        /** Number of times stage k calls its processing function per iteration. */
+        size_t calls_per_iteration(size_t k) const
+        {
+            return samples_per_iteration(k) / stages[k].block_in;
+        }
+
+        /** Output sample rate relative to the input sample rate. */
+        double output_rate() const
+        {
+            return (double) rate_num.back() / rate_den.back();
+        }
+
+        /**
+         * Delay in input samples from a sample entering the first stage until
+         * it leaves the last stage, which is 1 hyper-block per extra stage.
+         */
+        size_t pipeline_delay() const
+        {
+            return (stages.size() - 1) * hyper_size;
+        }
+
+        /**
+         * Total latency in input samples for every output sample of a
+         * real-time stream, which is the pipeline delay plus 1 hyper-block
+         * that must be buffered before the first iteration can start.
+         */
+        size_t latency() const
+        {
+            return stages.size() * hyper_size;
+        }
+
+        /**
+         * Serial processing of the input samples, where all the stages are
+         * run one after another in a single thread. The input is padded with
+         * zeros to a whole number of hyper-blocks.
+         *
+         * @param input Input samples.
+         * @return Output samples.
+         */
+        vector<float> serial(vector<float> const& input) const
+        {
+            Rebuffer in;
+            in.push(make_block(input));
+            in.push(make_block(vector<float>((hyper_size - input.size() % hyper_size) % hyper_size)));
+
+            Rebuffer out;
+            while (in.size() > 0)
+            {
+                Block block = in.pop(hyper_size);
+
+                for (size_t k=0; k<stages.size(); k++)
+                {
+                    Rebuffer link;
+                    link.push(block);
+
+                    vector<Block> blocks;
+                    while (link.size() > 0)
+                    {
+                        blocks.push_back(link.pop(stages[k].block_in));
+                    }
+
+                    block = process_blocks(stages[k], blocks);
+                }
+
+                out.push(block);
+            }
+
+            Block y = out.pop(out.size());
+            return y.data;
+        }
+
+        /**
+         * Parallel processing of the input samples, where each stage runs in
+         * its own thread. The output includes the silence that is produced
+         * while the pipeline is being filled, so an output sample is delayed
+         * by exactly pipeline_delay() input samples compared to serial().
+         *
+         * @param input Input samples.
+         * @param verbose Whether to print each iteration.
+         * @return Output samples.
+         */
+        vector<float> parallel(vector<float> const& input, bool verbose = false) const
+        {
+            size_t K = stages.size();
+
+            // Input samples padded with zeros to a whole number of hyper-blocks.
+            Rebuffer in;
+            in.push(make_block(input));
+            in.push(make_block(vector<float>((hyper_size - input.size() % hyper_size) % hyper_size)));
+            size_t num_hyper = in.size() / hyper_size;
+
+            // Links between the stages, where links[k] is the input of stage k.
+            vector<Rebuffer> links(K);
+
+            // Output samples.
+            Rebuffer out;
+
+            // Note that we need K-1 extra iterations because of the buffering.
+            for (size_t i=0; i<num_hyper + K - 1; i++)
+            {
+                // Feed the next hyper-block into the first stage.
+                if (i < num_hyper)
+                {
+                    links[0].push(in.pop(hyper_size));
+                }
+
+                // Take the blocks for each stage from its link. A stage with no
+                // buffered data is a bubble in this iteration.
+                vector<vector<Block>> blocks(K);
+                for (size_t k=0; k<K; k++)
+                {
+                    if (links[k].size() >= samples_per_iteration(k))
+                    {
+                        for (size_t c=0; c<calls_per_iteration(k); c++)
+                        {
+                            blocks[k].push_back(links[k].pop(stages[k].block_in));
+                        }
+                    }
+                }
+
+                // Async execution of all the stages that have data.
+                vector<future<Block>> futures(K);
+                for (size_t k=0; k<K; k++)
+                {
+                    if (!blocks[k].empty())
+                    {
+                        futures[k] = async(process_blocks, cref(stages[k]), cref(blocks[k]));
+                    }
+                }
+
+                // Wait for the stages to finish and move their output to the
+                // links for the next iteration.
+                if (verbose)
+                {
+                    cout << "Step " + to_string(i) + ":";
+                }
+
+                for (size_t k=0; k<K; k++)
+                {
+                    Block result;
+                    if (futures[k].valid())
+                    {
+                        result = futures[k].get();
+                    }
+
+                    if (verbose)
+                    {
+                        cout << "  " << stages[k].name << ": ";
+                        if (blocks[k].empty())
+                        {
+                            cout << no_data;
+                        }
+                        else
+                        {
+                            cout << blocks[k].size() << "x" << stages[k].block_in;
+                        }
+                    }
+
+                    if (k + 1 < K)
+                    {
+                        links[k + 1].push(result);
+                    }
+                    else if (is_no_data(result))
+                    {
+                        // Silence while the pipeline is being filled.
+                        out.push(make_block(vector<float>(samples_per_iteration(K))));
+                    }
+                    else
+                    {
+                        out.push(result);
+                    }
+                }
+
+                if (verbose)
+                {
+                    cout << endl;
+                }
+            }
+
+            Block y = out.pop(out.size());
+            return y.data;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
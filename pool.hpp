@@ -0,0 +1,284 @@
+/******************************************************************************
+ * Worker pool for parallel work inside a single stage of a Parallel Pipeline,
+ * e.g. when a stage processes many independent audio channels in each block.
+ *
+ * The stage threads of the pipeline already use some of the CPU cores, so the
+ * pool should only have a worker thread for each of the spare cores. The
+ * stage thread that calls parallel_for() also processes items itself while
+ * it waits, so a heavy stage uses its own core plus the spare cores, and the
+ * CPU is not oversubscribed with more busy threads than cores.
+ *
+ * Several stages may call parallel_for() at the same time, and the workers
+ * then help whichever stage's job is first in the queue.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "block.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Number of spare CPU cores that are not used by the stage threads of the
+ * pipeline, which is the number of worker threads a shared pool should have.
+ *
+ * @param num_stage_threads Number of stage threads in the pipeline.
+ * @return Number of spare cores, which may be 0.
+ */
+size_t spare_cores(size_t num_stage_threads)
+{
+    size_t num_cores = thread::hardware_concurrency();
+    return (num_cores > num_stage_threads) ? num_cores - num_stage_threads : 0;
+}
+
+/*****************************************************************************/
+
+/** Pool of worker threads that help the stage threads with parallel loops. */
+class WorkerPool
+{
+    private:
+        // Parallel loop that is being processed.
+        struct Job
+        {
+            // Function called for each index in [0, n).
+            function<void(size_t)> const* func;
+
+            // Number of indices.
+            size_t n;
+
+            // Next index to be processed.
+            atomic<size_t> next{0};
+
+            // Number of indices that have been processed.
+            atomic<size_t> done{0};
+
+            // Number of worker threads using the job, protected by the lock.
+            size_t active = 0;
+        };
+
+        // Jobs that still have indices which are not started.
+        deque<Job*> jobs;
+
+        // Lock and signal for the job-queue.
+        mutex jobs_mutex;
+        condition_variable jobs_cv;
+
+        // Signal for a job being done.
+        condition_variable done_cv;
+
+        // Whether the workers should stop.
+        bool stop = false;
+
+        // Worker threads.
+        vector<thread> workers;
+
+        /** Process indices of the job until there are no more to start. */
+        static void work(Job& job)
+        {
+            for (size_t i=job.next++; i<job.n; i=job.next++)
+            {
+                (*job.func)(i);
+                job.done++;
+            }
+        }
+
+        /** Main loop for the worker threads. */
+        void run_worker()
+        {
+            unique_lock<mutex> lock(jobs_mutex);
+
+            while (true)
+            {
+                jobs_cv.wait(lock, [this] { return stop || !jobs.empty(); });
+
+                if (stop)
+                {
+                    return;
+                }
+
+                Job* job = jobs.front();
+
+                // Remove the job from the queue when all indices are started.
+                if (job->next >= job->n)
+                {
+                    jobs.pop_front();
+                    continue;
+                }
+
+                // Process the job without holding the lock. The job stays
+                // alive while it is active in a worker thread.
+                job->active++;
+                lock.unlock();
+                work(*job);
+                lock.lock();
+                job->active--;
+
+                if (job->active == 0 && job->done == job->n)
+                {
+                    done_cv.notify_all();
+                }
+            }
+        }
+
+    public:
+        /**
+         * Create a pool with the given number of worker threads.
+         *
+         * @param num_workers Number of worker threads, e.g. spare_cores().
+         */
+        WorkerPool(size_t num_workers)
+        {
+            for (size_t w=0; w<num_workers; w++)
+            {
+                workers.emplace_back(&WorkerPool::run_worker, this);
+            }
+        }
+
+        WorkerPool(WorkerPool const&) = delete;
+        WorkerPool& operator=(WorkerPool const&) = delete;
+
+        /** Stop and join the worker threads. */
+        ~WorkerPool()
+        {
+            {
+                lock_guard<mutex> lock(jobs_mutex);
+                stop = true;
+            }
+            jobs_cv.notify_all();
+
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+        }
+
+        /** Number of worker threads. */
+        size_t size() const
+        {
+            return workers.size();
+        }
+
+        /**
+         * Call the function for each index in [0, n) using the worker threads
+         * and the calling thread, and wait until all calls have finished.
+         *
+         * @param n Number of indices.
+         * @param func Function called for each index.
+         */
+        void parallel_for(size_t n, function<void(size_t)> const& func)
+        {
+            if (n == 0)
+            {
+                return;
+            }
+
+            Job job;
+            job.func = &func;
+            job.n = n;
+
+            // Let the workers help with the job.
+            if (!workers.empty())
+            {
+                lock_guard<mutex> lock(jobs_mutex);
+                jobs.push_back(&job);
+            }
+            jobs_cv.notify_all();
+
+            // The calling thread also processes indices.
+            work(job);
+
+            // Wait for the workers to finish their indices, and make sure the
+            // job is no longer used or in the queue before it goes out of scope.
+            unique_lock<mutex> lock(jobs_mutex);
+            done_cv.wait(lock, [&job] { return job.done == job.n && job.active == 0; });
+
+            for (auto it=jobs.begin(); it!=jobs.end(); ++it)
+            {
+                if (*it == &job)
+                {
+                    jobs.erase(it);
+                    break;
+                }
+            }
+        }
+};
+
+/*****************************************************************************/
+
+/** Block of audio samples for each of several independent channels. */
+using Channels = vector<Block>;
+
+/** Whether there are no channels, which means it is a bubble in the pipeline. */
+bool is_no_data(Channels const& x)
+{
+    return x.empty();
+}
+
+/**
+ * Processing stage that declares its work as independent for each channel,
+ * so the channels can be processed in parallel by a shared worker pool.
+ */
+class ChannelStage
+{
+    private:
+        // Processing function for a single channel.
+        function<Block(Block const&)> process;
+
+        // Shared worker pool, or null to process the channels in serial.
+        WorkerPool* pool;
+
+    public:
+        /**
+         * Create a channel-parallel stage.
+         *
+         * @param process Processing function for a single channel.
+         * @param pool Shared worker pool, or null.
+         */
+        ChannelStage(function<Block(Block const&)> process, WorkerPool* pool = nullptr)
+            : process(process), pool(pool) {}
+
+        /**
+         * Process all channels of a block.
+         *
+         * @param x Input channels.
+         * @return Output channels.
+         */
+        Channels operator()(Channels const& x) const
+        {
+            Channels y(x.size());
+            auto func = [&](size_t c) { y[c] = process(x[c]); };
+
+            if (pool)
+            {
+                pool->parallel_for(x.size(), func);
+            }
+            else
+            {
+                for (size_t c=0; c<x.size(); c++)
+                {
+                    func(c);
+                }
+            }
+
+            return y;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,427 @@
+/******************************************************************************
+ * Parallel Pipeline that is prepared for real-time use, so there are no page
+ * faults or memory allocations while it is running.
+ *
+ * In main1.cpp to main4.cpp, each iteration of parallel() starts new threads
+ * and allocates new strings or blocks for the output of the stages. In a
+ * real-time audio thread, every malloc() may take a lock, and every page
+ * fault may have to wait for the OS, which can take longer than the period
+ * of the audio callback and cause an audible dropout.
+ *
+ * This pipeline is therefore prepared once before it is used:
+ *
+ *  - All the buffers between the stages are allocated in one region of whole
+ *    memory pages, and written to, so their pages are mapped by the OS.
+ *  - The stages run in persistent threads like in host.hpp, and each thread
+ *    writes to the top of its stack so those pages are also mapped.
+ *  - Optionally, the buffers and stacks are locked in RAM with mlock(), so
+ *    the OS cannot swap them out. This needs enough RLIMIT_MEMLOCK, and the
+ *    pipeline still works if the locking fails.
+ *
+ * The stages process raw arrays of samples instead of returning new blocks.
+ * To check that they really do not allocate, define REALTIME_CHECK_ALLOC
+ * before including this file, in exactly one translation unit of a debug
+ * build, i.e. where NDEBUG is not defined. This file then replaces the global
+ * operator new and delete for the whole program, and asserts that they are
+ * not called by a stage or the callback while the pipeline is running.
+ *
+ * This uses POSIX semaphores so it only works on Linux and similar systems.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <semaphore.h>
+#include <new>
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+using namespace std;
+
+/*****************************************************************************/
+
+// Whether the calling thread is in the real-time loop, where it must not
+// allocate or free memory.
+inline thread_local bool in_realtime_loop = false;
+
+/** Scope in which the calling thread is in the real-time loop. */
+class RealtimeScope
+{
+    public:
+        RealtimeScope()
+        {
+            in_realtime_loop = true;
+        }
+
+        ~RealtimeScope()
+        {
+            in_realtime_loop = false;
+        }
+};
+
+#if defined(REALTIME_CHECK_ALLOC) && !defined(NDEBUG)
+
+// Replacements for the global operator new and delete, which assert that
+// there is no allocation in the real-time loop. The array, nothrow and sized
+// versions call these by default.
+
+void* operator new(size_t size)
+{
+    assert(!in_realtime_loop && "Memory allocated in the real-time loop.");
+
+    void* ptr = malloc(max(size, (size_t) 1));
+    if (ptr == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, align_val_t align)
+{
+    assert(!in_realtime_loop && "Memory allocated in the real-time loop.");
+
+    // The size for aligned_alloc() must be a multiple of the alignment.
+    size_t a = (size_t) align;
+    void* ptr = aligned_alloc(a, (max(size, (size_t) 1) + a - 1) / a * a);
+    if (ptr == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    assert(!in_realtime_loop && "Memory freed in the real-time loop.");
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t, align_val_t) noexcept
+{
+    operator delete(ptr);
+}
+
+#endif
+
+/*****************************************************************************/
+
+/** Processing stage that writes n output samples for n input samples. */
+using RealtimeStage = function<void(float const* in, float* out, size_t n)>;
+
+/** Options for preparing a pipeline for real-time use. */
+struct RealtimeOptions
+{
+    // Number of bytes at the top of each thread's stack to pre-fault.
+    size_t stack_bytes = 256 * 1024;
+
+    // Whether to lock the buffers and stacks in RAM.
+    bool lock_memory = false;
+};
+
+/*****************************************************************************/
+
+/**
+ * Parallel Pipeline for a chain of stages y = S_K(...S_1(x)) which runs in
+ * persistent threads without page faults or allocations.
+ *
+ * In the iteration started by callback i, stage k processes the output that
+ * stage k-1 produced in iteration i-1, like F_buffer and G_buffer in
+ * main2.cpp. Each stage has two output buffers that are swapped between the
+ * iterations, like in host.hpp.
+ */
+class RealtimePipeline
+{
+    private:
+        // Processing stages.
+        vector<RealtimeStage> stages;
+
+        // Number of samples in each callback.
+        size_t block_size;
+
+        // Options for the preparation.
+        RealtimeOptions options;
+
+        // Memory for all the buffers, which is whole pages so locking it
+        // does not affect other data, and its size in bytes.
+        char* memory = nullptr;
+        size_t memory_bytes = 0;
+
+        // Input block for the first stage, written by the callback.
+        float* input = nullptr;
+
+        // Double-buffered output of each stage, where output[k][i % 2] is
+        // written by stage k in iteration i.
+        vector<array<float*, 2>> output;
+
+        // Semaphores for each stage thread to start an iteration, and for the
+        // callback to wait until the stages have finished it.
+        vector<sem_t> start;
+        sem_t done;
+
+        // Number of iterations started by the callback.
+        size_t num_started = 0;
+
+        // Whether the stage threads should stop.
+        atomic<bool> stop{false};
+
+        // Whether locking the memory failed for any buffer or stack.
+        atomic<bool> lock_failed{false};
+
+        // Persistent stage threads.
+        vector<thread> threads;
+
+        /** Lock memory in RAM if this is enabled, and record a failure. */
+        bool lock(void const* addr, size_t size)
+        {
+            if (!options.lock_memory)
+            {
+                return false;
+            }
+            if (mlock(addr, size) != 0)
+            {
+                lock_failed.store(true);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * Write to the top of the calling thread's stack so its pages are
+         * mapped, and lock the whole pages among them. This must not be
+         * inlined, so the stack frame is released when it returns.
+         *
+         * @param locked_begin Start of the locked range, or 0 if not locked.
+         * @param locked_size Size of the locked range.
+         */
+        __attribute__((noinline)) void prefault_stack(uintptr_t& locked_begin, size_t& locked_size)
+        {
+            size_t page = sysconf(_SC_PAGESIZE);
+            volatile char* stack = (volatile char*) alloca(options.stack_bytes);
+            for (size_t i=0; i<options.stack_bytes; i+=page)
+            {
+                stack[i] = 0;
+            }
+
+            // Only whole pages are locked, which are not shared with the
+            // stack frames above.
+            uintptr_t begin = ((uintptr_t) stack + page - 1) / page * page;
+            uintptr_t end = ((uintptr_t) stack + options.stack_bytes) / page * page;
+            locked_begin = 0;
+            locked_size = 0;
+            if (end > begin && lock((void const*) begin, end - begin))
+            {
+                locked_begin = begin;
+                locked_size = end - begin;
+            }
+        }
+
+        /** Main loop for the thread running stage k. */
+        void run_stage(size_t k)
+        {
+            uintptr_t locked_begin;
+            size_t locked_size;
+            prefault_stack(locked_begin, locked_size);
+            sem_post(&done);
+
+            for (size_t i=0; ; i++)
+            {
+                sem_wait(&start[k]);
+
+                if (stop.load())
+                {
+                    // The stack may be reused by another thread, so it is
+                    // unlocked by this thread before it ends.
+                    if (locked_size > 0)
+                    {
+                        munlock((void const*) locked_begin, locked_size);
+                    }
+                    return;
+                }
+
+                {
+                    RealtimeScope scope;
+
+                    // Input is either from the callback or from the previous
+                    // stage in the previous iteration.
+                    float const* x = (k == 0) ? input : output[k - 1][(i + 1) % 2];
+                    stages[k](x, output[k][i % 2], block_size);
+                }
+
+                sem_post(&done);
+            }
+        }
+
+    public:
+        /**
+         * Prepare the pipeline for real-time use and start the stage threads.
+         * This allocates everything the pipeline needs, so it must not be
+         * called from the real-time thread.
+         *
+         * @param stages Processing stages in the order they are applied.
+         * @param block_size Number of samples in each callback.
+         * @param options Options for the preparation.
+         */
+        RealtimePipeline(vector<RealtimeStage> const& stages, size_t block_size,
+                         RealtimeOptions const& options = RealtimeOptions())
+            : stages(stages), block_size(block_size), options(options),
+              output(stages.size()), start(stages.size())
+        {
+            if (stages.empty())
+            {
+                throw invalid_argument("RealtimePipeline needs a stage.");
+            }
+
+            // One region of whole pages for the input and the 2 output
+            // buffers of each stage, where each buffer is 64-byte aligned.
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t buffer_bytes = (block_size * sizeof(float) + 63) / 64 * 64;
+            size_t num_buffers = 1 + 2 * stages.size();
+            memory_bytes = (num_buffers * buffer_bytes + page - 1) / page * page;
+
+            void* addr = mmap(nullptr, memory_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED)
+            {
+                throw runtime_error("Cannot map memory for RealtimePipeline.");
+            }
+            memory = (char*) addr;
+
+            // The buffers are filled with zeros, so their pages are mapped.
+            memset(memory, 0, memory_bytes);
+            lock(memory, memory_bytes);
+
+            input = (float*) memory;
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                output[k][0] = (float*) (memory + (1 + 2 * k) * buffer_bytes);
+                output[k][1] = (float*) (memory + (2 + 2 * k) * buffer_bytes);
+            }
+
+            sem_init(&done, 0, 0);
+            for (auto& s : start)
+            {
+                sem_init(&s, 0, 0);
+            }
+
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                threads.emplace_back(&RealtimePipeline::run_stage, this, k);
+            }
+
+            // Wait until all the threads have pre-faulted their stacks.
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                sem_wait(&done);
+            }
+        }
+
+        RealtimePipeline(RealtimePipeline const&) = delete;
+        RealtimePipeline& operator=(RealtimePipeline const&) = delete;
+
+        /** Stop and join the stage threads. */
+        ~RealtimePipeline()
+        {
+            stop.store(true);
+
+            for (auto& s : start)
+            {
+                sem_post(&s);
+            }
+
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+
+            for (auto& s : start)
+            {
+                sem_destroy(&s);
+            }
+            sem_destroy(&done);
+
+            // Unmapping the memory also unlocks it.
+            munmap(memory, memory_bytes);
+        }
+
+        /**
+         * Latency in samples added by the pipeline, because the output of
+         * callback i is the result for the input of callback i-(K-1) where K
+         * is the number of stages.
+         */
+        size_t latency() const
+        {
+            return (stages.size() - 1) * block_size;
+        }
+
+        /** Whether the buffers and stacks are locked in RAM. */
+        bool locked() const
+        {
+            return options.lock_memory && !lock_failed.load();
+        }
+
+        /**
+         * Host-style block callback, which runs one iteration of all the
+         * stages and waits for them. It does not allocate any memory.
+         *
+         * @param in Input samples.
+         * @param out Output samples.
+         * @param n Number of samples, which must equal the block size.
+         */
+        void process(float const* in, float* out, int n)
+        {
+            if ((size_t) n != block_size)
+            {
+                throw invalid_argument("RealtimePipeline got wrong block size.");
+            }
+
+            RealtimeScope scope;
+
+            copy(in, in + n, input);
+
+            for (auto& s : start)
+            {
+                sem_post(&s);
+            }
+            for (size_t k=0; k<stages.size(); k++)
+            {
+                sem_wait(&done);
+            }
+
+            // Output of the last stage in this iteration, which is silence
+            // while the pipeline is being filled.
+            float const* y = output[stages.size() - 1][num_started % 2];
+            copy(y, y + n, out);
+            num_started++;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
@@ -0,0 +1,386 @@
+/******************************************************************************
+ * String payload for text-processing pipelines, which is a rope of pieces
+ * allocated in an arena, so wrapping and joining strings is O(1) per stage.
+ *
+ * The dummy functions in common.hpp wrap their input as "F(" + x + ")" and
+ * join two inputs as x + " + " + y. With std::string, each of these copies
+ * the whole string, so a chain of K stages copies O(K^2) bytes in total when
+ * each stage adds a little to a long string. This is common in real text
+ * pipelines such as tokenizers, normalizers and formatters.
+ *
+ * A rope is instead a tree where the leaves are pieces of text and the inner
+ * nodes are concatenations of two ropes. Wrapping and joining only allocate a
+ * few new nodes, and the text is only copied once when the rope is flattened
+ * to a std::string at the sink of the pipeline. The nodes are never changed
+ * after they are made, so a rope can be shared by several stages in
+ * different threads.
+ *
+ * The nodes are allocated in an arena, which hands out memory from large
+ * chunks and frees it all at once when it is reset, so there is no malloc()
+ * or free() for each node. An arena cannot be reset while any rope in it is
+ * still in the pipeline, so a single arena grows for the whole stream. For a
+ * long stream, the DoubleArena below alternates between two arenas for
+ * groups of items, and resets the older one when all its items are done.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef ROPE_HPP
+#define ROPE_HPP
+
+#include <new>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * Arena for the memory of a pipeline, which is freed all at once. The
+ * allocation is thread-safe so it can be used by all the stage threads.
+ */
+class Arena
+{
+    private:
+        // Size of each chunk of memory.
+        size_t chunk_size;
+
+        // Chunks of memory, where the last one is currently used.
+        vector<unique_ptr<char[]>> chunks;
+
+        // Number of bytes used in the current chunk.
+        size_t used;
+
+        // Total number of bytes allocated.
+        size_t total = 0;
+
+        // Lock for the allocation.
+        mutex arena_mutex;
+
+    public:
+        /**
+         * @param chunk_size Size of each chunk of memory.
+         */
+        Arena(size_t chunk_size = 1 << 20) : chunk_size(chunk_size), used(chunk_size) {}
+
+        Arena(Arena const&) = delete;
+        Arena& operator=(Arena const&) = delete;
+
+        /**
+         * Allocate memory which lives until the arena is reset or destroyed.
+         *
+         * @param size Number of bytes.
+         * @return Pointer to the memory, aligned for any type.
+         */
+        void* allocate(size_t size)
+        {
+            size_t align = alignof(max_align_t);
+            size = (size + align - 1) / align * align;
+
+            lock_guard<mutex> lock(arena_mutex);
+            total += size;
+
+            // Large allocations get their own chunk, which is put before the
+            // current chunk so it can still be used.
+            if (size > chunk_size / 4)
+            {
+                unique_ptr<char[]> chunk(new char[size]);
+                void* ptr = chunk.get();
+                chunks.insert(chunks.end() - (chunks.empty() ? 0 : 1), move(chunk));
+                return ptr;
+            }
+
+            if (used + size > chunk_size)
+            {
+                chunks.emplace_back(new char[chunk_size]);
+                used = 0;
+            }
+
+            void* ptr = chunks.back().get() + used;
+            used += size;
+            return ptr;
+        }
+
+        /** Free all the memory. All ropes made in the arena become invalid. */
+        void reset()
+        {
+            lock_guard<mutex> lock(arena_mutex);
+            chunks.clear();
+            used = chunk_size;
+            total = 0;
+        }
+
+        /** Total number of bytes allocated since the last reset. */
+        size_t allocated()
+        {
+            lock_guard<mutex> lock(arena_mutex);
+            return total;
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Two arenas which are used in turn for groups of items in a stream, so the
+ * memory does not grow for the whole stream. The ropes of item i must all be
+ * made in the arena for item i, which is reset when it is used again for a
+ * new group of items. This is safe when all the ropes of the older group are
+ * flattened by then, which is the case when the number of items per group is
+ * at least the number of iterations that an item is in the pipeline.
+ *
+ * Only the source of the pipeline may call for_item(), because it resets
+ * the arena, but the stages may allocate in the arenas concurrently.
+ */
+class DoubleArena
+{
+    private:
+        // Number of items in each group.
+        size_t items_per_arena;
+
+        // The two arenas.
+        Arena arenas[2];
+
+        // Index of the group whose items are currently being made.
+        size_t group = 0;
+
+    public:
+        /**
+         * @param items_per_arena Number of items in each group, which must be
+         *                        at least the number of iterations that an
+         *                        item is in the pipeline.
+         * @param chunk_size Size of each chunk of memory in the arenas.
+         */
+        DoubleArena(size_t items_per_arena, size_t chunk_size = 1 << 20)
+            : items_per_arena(max(items_per_arena, (size_t) 1)), arenas{Arena(chunk_size), Arena(chunk_size)} {}
+
+        /**
+         * Arena for making the ropes of item i. When item i starts a new
+         * group, the arena is reset, which frees the group before the
+         * previous group. The items must be made in increasing order.
+         */
+        Arena& for_item(size_t i)
+        {
+            size_t g = i / items_per_arena;
+            Arena& arena = arenas[g % 2];
+            if (g > group)
+            {
+                group = g;
+                arena.reset();
+            }
+            return arena;
+        }
+
+        /** Total number of bytes allocated in both arenas since their last reset. */
+        size_t allocated()
+        {
+            return arenas[0].allocated() + arenas[1].allocated();
+        }
+};
+
+/*****************************************************************************/
+
+/** Immutable string which is a tree of pieces of text in an arena. */
+class Rope
+{
+    private:
+        // Node in the tree, which is either a leaf with text or a
+        // concatenation of two ropes.
+        struct Node
+        {
+            // Total length of the text.
+            size_t length;
+
+            // Text of a leaf, or nullptr for a concatenation.
+            char const* text;
+
+            // Children of a concatenation.
+            Node const* left;
+            Node const* right;
+        };
+
+        // Arena with the nodes, and the root of the tree, which is nullptr
+        // for an empty rope or for no_data.
+        Arena* arena = nullptr;
+        Node const* root = nullptr;
+
+        // Whether the rope is no_data, which is a bubble in the pipeline.
+        bool bubble = true;
+
+        Rope(Arena* arena, Node const* root) : arena(arena), root(root), bubble(false) {}
+
+        /** Allocate a leaf with a copy of the text. */
+        static Node const* make_leaf(Arena& arena, char const* text, size_t length)
+        {
+            if (length == 0)
+            {
+                return nullptr;
+            }
+
+            char* copy = (char*) arena.allocate(length);
+            memcpy(copy, text, length);
+            return new (arena.allocate(sizeof(Node))) Node{length, copy, nullptr, nullptr};
+        }
+
+        /** Allocate a concatenation of two nodes. */
+        static Node const* make_concat(Arena& arena, Node const* left, Node const* right)
+        {
+            if (left == nullptr) return right;
+            if (right == nullptr) return left;
+            return new (arena.allocate(sizeof(Node)))
+                Node{left->length + right->length, nullptr, left, right};
+        }
+
+    public:
+        /** Rope which is no_data, i.e. a bubble in the pipeline. */
+        Rope() {}
+
+        /**
+         * Rope with a copy of a string.
+         *
+         * @param arena Arena for the nodes.
+         * @param text Text of the rope.
+         */
+        Rope(Arena& arena, string const& text)
+            : Rope(&arena, make_leaf(arena, text.data(), text.size())) {}
+
+        /** Length of the text. */
+        size_t size() const
+        {
+            return (root != nullptr) ? root->length : 0;
+        }
+
+        /** Whether the rope is no_data. */
+        bool is_bubble() const
+        {
+            return bubble;
+        }
+
+        /**
+         * Concatenation of this rope and another rope, which is O(1).
+         * Both ropes must be in the same arena. The result is a bubble
+         * if either rope is a bubble.
+         */
+        Rope operator+(Rope const& other) const
+        {
+            if (bubble)
+            {
+                return *this;
+            }
+            if (other.bubble)
+            {
+                return other;
+            }
+            return Rope(arena, make_concat(*arena, root, other.root));
+        }
+
+        /**
+         * Concatenation of this rope and a string, which copies the string
+         * only. The result is a bubble if this rope is a bubble.
+         */
+        Rope operator+(string const& text) const
+        {
+            if (bubble)
+            {
+                return *this;
+            }
+            return Rope(arena, make_concat(*arena, root, make_leaf(*arena, text.data(), text.size())));
+        }
+
+        /**
+         * Prefix and suffix around this rope, e.g. "F(" + x + ")", which
+         * copies the prefix and suffix only. The result is a bubble if this
+         * rope is a bubble.
+         */
+        Rope wrap(string const& prefix, string const& suffix) const
+        {
+            if (bubble)
+            {
+                return *this;
+            }
+
+            Node const* left = make_leaf(*arena, prefix.data(), prefix.size());
+            Node const* right = make_leaf(*arena, suffix.data(), suffix.size());
+            return Rope(arena, make_concat(*arena, make_concat(*arena, left, root), right));
+        }
+
+        /**
+         * Flatten the rope to a string, which copies the text once. This is
+         * iterative so it works for very deep trees.
+         */
+        string flatten() const
+        {
+            if (bubble)
+            {
+                return no_data;
+            }
+
+            string out;
+            out.reserve(size());
+
+            vector<Node const*> stack;
+            if (root != nullptr)
+            {
+                stack.push_back(root);
+            }
+
+            while (!stack.empty())
+            {
+                Node const* node = stack.back();
+                stack.pop_back();
+
+                if (node->text != nullptr)
+                {
+                    out.append(node->text, node->length);
+                }
+                else
+                {
+                    // The right child is pushed first so the left is appended first.
+                    stack.push_back(node->right);
+                    stack.push_back(node->left);
+                }
+            }
+
+            return out;
+        }
+};
+
+/*****************************************************************************/
+
+/** Whether the rope is no_data, like is_no_data() for strings in common.hpp. */
+bool is_no_data(Rope const& x)
+{
+    return x.is_bubble();
+}
+
+/** Dummy processing function + for ropes, like sum() in common.hpp. */
+Rope sum(Rope const& x, Rope const& y)
+{
+    if (is_no_data(x) && is_no_data(y))
+    {
+        return Rope();
+    }
+    else if (is_no_data(x))
+    {
+        return y.wrap(no_data + " + ", "");
+    }
+    else if (is_no_data(y))
+    {
+        return x.wrap("", " + " + no_data);
+    }
+
+    return (x + " + ") + y;
+}
+
+/*****************************************************************************/
+
+#endif
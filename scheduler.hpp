@@ -0,0 +1,402 @@
+/******************************************************************************
+ * Process-wide worker pool that runs many Parallel Pipelines at the same
+ * time, with Quality of Service (QoS) classes and deadlines.
+ *
+ * In main1.cpp to main4.cpp, each call of parallel() starts its own threads
+ * for every iteration and waits for them to finish. When a server runs many
+ * pipelines at the same time, this would give hundreds of threads fighting
+ * over the CPU cores. Instead, the pipelines here submit the stage-calls of
+ * each iteration as tasks to a shared pool with one worker per core. When
+ * the last task of an iteration finishes, it starts the next iteration, so no
+ * thread is blocked waiting for the other stages.
+ *
+ * The workers always take the task with the highest QoS class, and within
+ * the same class the task with the earliest deadline. So a real-time pipeline
+ * preempts batch pipelines at the boundaries between their tasks, without
+ * interrupting a stage-call that is already running.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <mutex>
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "common.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Quality of Service class, where a lower value has higher priority. */
+enum class QoS { RealTime = 0, Interactive = 1, Batch = 2 };
+
+/** Shared pool of worker threads for many pipelines. */
+class SharedPool
+{
+    public:
+        // Type used for deadlines and release times.
+        using clock_type = chrono::steady_clock;
+
+    private:
+        // Task for a worker thread.
+        struct Task
+        {
+            // QoS class of the pipeline.
+            QoS qos;
+
+            // Deadline used for ordering tasks within the same QoS class.
+            clock_type::time_point deadline;
+
+            // Time before which the task must not start.
+            clock_type::time_point release;
+
+            // Sequence number for FIFO order of otherwise equal tasks.
+            long seq;
+
+            // Work to be done.
+            function<void()> func;
+        };
+
+        // Order for the ready tasks: QoS class, then deadline, then FIFO.
+        struct ReadyOrder
+        {
+            bool operator()(Task const& a, Task const& b) const
+            {
+                if (a.qos != b.qos) return a.qos > b.qos;
+                if (a.deadline != b.deadline) return a.deadline > b.deadline;
+                return a.seq > b.seq;
+            }
+        };
+
+        // Order for the delayed tasks: release time.
+        struct ReleaseOrder
+        {
+            bool operator()(Task const& a, Task const& b) const
+            {
+                return a.release > b.release;
+            }
+        };
+
+        // Tasks that can start now, and tasks that are released later.
+        priority_queue<Task, vector<Task>, ReadyOrder> ready;
+        priority_queue<Task, vector<Task>, ReleaseOrder> delayed;
+
+        // Lock and signal for the task-queues.
+        mutex queue_mutex;
+        condition_variable queue_cv;
+
+        // Sequence number for the next task.
+        long next_seq = 0;
+
+        // Whether the workers should stop.
+        bool stop = false;
+
+        // Worker threads.
+        vector<thread> workers;
+
+        /** Main loop for the worker threads. */
+        void run_worker()
+        {
+            unique_lock<mutex> lock(queue_mutex);
+
+            while (!stop)
+            {
+                // Move the delayed tasks that have been released.
+                auto now = clock_type::now();
+                while (!delayed.empty() && delayed.top().release <= now)
+                {
+                    ready.push(delayed.top());
+                    delayed.pop();
+                }
+
+                if (!ready.empty())
+                {
+                    Task task = ready.top();
+                    ready.pop();
+
+                    lock.unlock();
+                    task.func();
+                    lock.lock();
+                }
+                else if (!delayed.empty())
+                {
+                    queue_cv.wait_until(lock, delayed.top().release);
+                }
+                else
+                {
+                    queue_cv.wait(lock);
+                }
+            }
+        }
+
+    public:
+        /**
+         * Create the pool.
+         *
+         * @param num_workers Number of worker threads, e.g. number of cores.
+         */
+        SharedPool(size_t num_workers)
+        {
+            for (size_t w=0; w<num_workers; w++)
+            {
+                workers.emplace_back(&SharedPool::run_worker, this);
+            }
+        }
+
+        SharedPool(SharedPool const&) = delete;
+        SharedPool& operator=(SharedPool const&) = delete;
+
+        /** Stop and join the worker threads. Queued tasks are discarded. */
+        ~SharedPool()
+        {
+            {
+                lock_guard<mutex> lock(queue_mutex);
+                stop = true;
+            }
+            queue_cv.notify_all();
+
+            for (auto& w : workers)
+            {
+                w.join();
+            }
+        }
+
+        /** Number of worker threads. */
+        size_t size() const
+        {
+            return workers.size();
+        }
+
+        /**
+         * Submit a task to the pool.
+         *
+         * @param qos QoS class.
+         * @param deadline Deadline for ordering tasks in the same QoS class.
+         * @param release Time before which the task must not start.
+         * @param func Work to be done.
+         */
+        void submit(QoS qos, clock_type::time_point deadline,
+                    clock_type::time_point release, function<void()> func)
+        {
+            {
+                lock_guard<mutex> lock(queue_mutex);
+                Task task{qos, deadline, release, next_seq++, move(func)};
+
+                if (release <= clock_type::now())
+                {
+                    ready.push(move(task));
+                }
+                else
+                {
+                    delayed.push(move(task));
+                }
+            }
+
+            // All workers are woken, because a waiting worker may need to
+            // recalculate the time until the next release.
+            queue_cv.notify_all();
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Parallel Pipeline for a chain of stages y = S_K(...S_1(x)), which runs its
+ * stage-calls as tasks in a shared pool. The iterations are in lockstep as in
+ * main2.cpp, but the last task of an iteration starts the next iteration,
+ * instead of the calling thread waiting for all the stages.
+ */
+class PooledPipeline
+{
+    private:
+        // Type used for time.
+        using clock_type = SharedPool::clock_type;
+
+        // Shared pool of workers.
+        SharedPool& pool;
+
+        // Processing stages.
+        vector<function<string(string const&)>> stages;
+
+        // QoS class of this pipeline.
+        QoS qos;
+
+        // Time between the arrival of input items, or 0 for batch input.
+        chrono::milliseconds period;
+
+        // Time-budget for each iteration, which gives its deadline.
+        chrono::milliseconds budget;
+
+        // Input data, time of the first iteration, and iteration counter.
+        vector<string> x_vec;
+        clock_type::time_point time_start;
+        size_t iteration = 0;
+
+        // Buffered output of each stage from the previous iteration.
+        vector<string> buffers;
+
+        // Output of each stage in the current iteration.
+        vector<string> results;
+
+        // Number of tasks that are still running in the current iteration.
+        atomic<size_t> remaining{0};
+
+        // Release time of the current iteration.
+        clock_type::time_point release;
+
+        // Output of the pipeline, and a promise for when it is finished.
+        vector<string> y_vec;
+        promise<vector<string>> finished;
+
+        // Statistics.
+        long num_misses = 0;
+        double max_latency_ms = 0;
+
+        /** Start the current iteration by submitting its tasks to the pool. */
+        void start_iteration()
+        {
+            size_t K = stages.size();
+            size_t n = x_vec.size();
+
+            // All iterations are done.
+            if (iteration >= n + K - 1)
+            {
+                finished.set_value(y_vec);
+                return;
+            }
+
+            // The iteration is released when its input arrives, or now if
+            // the pipeline is lagging behind its input.
+            release = max(time_start + period * (long) iteration, clock_type::now());
+            auto deadline = release + budget;
+
+            // Input of each stage, which is either the new input item or the
+            // buffered output of the previous stage, like in main2.cpp.
+            vector<string> inputs(K);
+            inputs[0] = (iteration < n) ? x_vec[iteration] : no_data;
+            for (size_t k=1; k<K; k++)
+            {
+                inputs[k] = buffers[k - 1];
+            }
+
+            results.assign(K, no_data);
+
+            // Bubbles are skipped, but there is always at least one task so
+            // that the iteration is finished by a task.
+            size_t num_tasks = 0;
+            for (size_t k=0; k<K; k++)
+            {
+                num_tasks += (inputs[k] != no_data);
+            }
+            remaining.store(max(num_tasks, (size_t) 1));
+
+            if (num_tasks == 0)
+            {
+                pool.submit(qos, deadline, release, [this] { finish_task(); });
+            }
+
+            for (size_t k=0; k<K; k++)
+            {
+                if (inputs[k] != no_data)
+                {
+                    string x = inputs[k];
+                    pool.submit(qos, deadline, release, [this, k, x]
+                    {
+                        results[k] = stages[k](x);
+                        finish_task();
+                    });
+                }
+            }
+        }
+
+        /** Called when a task finishes, and the last one ends the iteration. */
+        void finish_task()
+        {
+            if (remaining.fetch_sub(1) != 1)
+            {
+                return;
+            }
+
+            // Statistics for the iteration.
+            chrono::duration<double, milli> latency = clock_type::now() - release;
+            max_latency_ms = max(max_latency_ms, latency.count());
+            if (latency > budget)
+            {
+                num_misses++;
+            }
+
+            // Save the output, like F_buffer and G_buffer in main2.cpp.
+            if (iteration >= stages.size() - 1)
+            {
+                y_vec.push_back(results.back());
+            }
+            buffers = results;
+
+            iteration++;
+            start_iteration();
+        }
+
+    public:
+        /**
+         * Create a pipeline that runs in a shared pool.
+         *
+         * @param pool Shared pool of workers.
+         * @param stages Processing stages in the order they are applied.
+         * @param qos QoS class.
+         * @param period Time between input items, or 0 for batch input.
+         * @param budget Time-budget for each iteration.
+         */
+        PooledPipeline(SharedPool& pool, vector<function<string(string const&)>> const& stages,
+                       QoS qos, chrono::milliseconds period, chrono::milliseconds budget)
+            : pool(pool), stages(stages), qos(qos), period(period), budget(budget),
+              buffers(stages.size(), no_data) {}
+
+        /**
+         * Start processing the input data. This returns immediately.
+         *
+         * @param x_vec Input data.
+         * @return Future with the output data.
+         */
+        future<vector<string>> run(vector<string> const& x_vec)
+        {
+            this->x_vec = x_vec;
+            time_start = clock_type::now();
+            iteration = 0;
+            buffers.assign(stages.size(), no_data);
+            y_vec.clear();
+            finished = promise<vector<string>>();
+            auto result = finished.get_future();
+            start_iteration();
+            return result;
+        }
+
+        /** Number of iterations that missed their deadline. */
+        long misses() const
+        {
+            return num_misses;
+        }
+
+        /** Max latency in milli-sec from the release to the end of an iteration. */
+        double max_latency() const
+        {
+            return max_latency_ms;
+        }
+};
+
+/*****************************************************************************/
+
+#endif
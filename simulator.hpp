@@ -0,0 +1,450 @@
+/******************************************************************************
+ * Discrete-event simulator for predicting the performance of a Parallel
+ * Pipeline without running the actual processing functions.
+ *
+ * The pipeline is described as a graph of stages, where each stage has a
+ * distribution for its processing time and a list of the stages whose output
+ * it uses as input. The simulator then runs the graph on a virtual clock in
+ * milli-sec, for one of these executors:
+ *
+ *   - Serial: all stages run one after another in a single thread, like the
+ *     serial() functions in main1.cpp to main4.cpp.
+ *
+ *   - Lockstep: each stage runs in its own thread on the buffered output of
+ *     the previous iteration, and all threads are joined after each
+ *     iteration, like the parallel() functions in main1.cpp to main4.cpp.
+ *
+ *   - Dataflow: each stage starts processing an item as soon as its inputs
+ *     are ready and it has a free thread, without joining all the threads
+ *     after each iteration. A stage may be farmed out to several threads.
+ *
+ * This can be used to explore how to partition the stages, farm them out or
+ * use mini-blocks, before deploying the pipeline, and the predictions can be
+ * compared to the elapsed time of the real benchmarks.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include <cmath>
+#include <queue>
+#include <string>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Distribution for the processing time of a stage in milli-sec. */
+using CostDist = function<double(mt19937&)>;
+
+/** Processing time which is always the same. */
+CostDist constant_cost(double ms)
+{
+    return [ms](mt19937&) { return ms; };
+}
+
+/** Processing time which is uniformly distributed in [low, high]. */
+CostDist uniform_cost(double low, double high)
+{
+    return [low, high](mt19937& rng)
+    {
+        return uniform_real_distribution<double>(low, high)(rng);
+    };
+}
+
+/** Processing time which is normally distributed, but never negative. */
+CostDist normal_cost(double mean, double std_dev)
+{
+    return [mean, std_dev](mt19937& rng)
+    {
+        return max(0.0, normal_distribution<double>(mean, std_dev)(rng));
+    };
+}
+
+/** Processing time which is sampled from a list of measured times. */
+CostDist empirical_cost(vector<double> const& samples)
+{
+    if (samples.empty())
+    {
+        throw invalid_argument("empirical_cost needs samples.");
+    }
+
+    return [samples](mt19937& rng)
+    {
+        return samples[uniform_int_distribution<size_t>(0, samples.size() - 1)(rng)];
+    };
+}
+
+/*****************************************************************************/
+
+/** Stage in the graph of a simulated pipeline. */
+struct SimStage
+{
+    // Name of the stage for printing.
+    string name;
+
+    // Distribution for the processing time of a whole item.
+    CostDist cost;
+
+    // Indices of the stages whose output is used as input to this stage.
+    // These must be lower than the index of this stage. No inputs means the
+    // stage takes its input from the source of the stream.
+    vector<size_t> inputs;
+
+    // Number of threads the stage is farmed out to. Only used by Dataflow.
+    size_t replicas = 1;
+};
+
+/** Type of executor for the simulated pipeline. */
+enum class Executor { Serial, Lockstep, Dataflow };
+
+/** Settings for the simulation. */
+struct SimConfig
+{
+    // Type of executor.
+    Executor executor = Executor::Lockstep;
+
+    // Number of items in the input stream.
+    size_t num_items = 10;
+
+    // Number of CPU cores.
+    size_t num_cores = 4;
+
+    // Number of mini-blocks that each item is split into.
+    size_t mini_blocks = 1;
+
+    // Overhead in milli-sec for each call of a processing function.
+    double overhead = 0.0;
+
+    // Time in milli-sec between the arrival of the items, or 0 if all the
+    // items are available at the start, as in main1.cpp to main4.cpp.
+    double period = 0.0;
+
+    // Seed for the random number generator.
+    unsigned seed = 42;
+};
+
+/** Predicted performance of the simulated pipeline. */
+struct SimResult
+{
+    // Time in milli-sec to process all the items.
+    double elapsed = 0;
+
+    // Number of items processed per second.
+    double throughput = 0;
+
+    // Mean and max latency in milli-sec from the arrival of a mini-block to
+    // the end of its processing in the last stage.
+    double mean_latency = 0;
+    double max_latency = 0;
+
+    // Fraction of the time the CPU cores were busy.
+    double utilization = 0;
+
+    // Time in milli-sec the CPU cores were idle, summed over all cores.
+    double idle_time = 0;
+
+    // Number of stage-calls that were bubbles while filling and draining.
+    long bubbles = 0;
+
+    /** Description of the result for printing. */
+    string describe() const
+    {
+        return "Elapsed time: " + to_string(elapsed) + "ms" +
+               ", Throughput: " + to_string(throughput) + "/s" +
+               ", Latency: " + to_string(mean_latency) + "ms (max " + to_string(max_latency) + "ms)" +
+               ", Utilization: " + to_string(100 * utilization) + "%" +
+               ", Bubbles: " + to_string(bubbles);
+    }
+};
+
+/*****************************************************************************/
+
+/**
+ * Simulate a pipeline on a virtual clock.
+ *
+ * @param stages Graph of the stages.
+ * @param config Settings for the simulation.
+ * @return Predicted performance.
+ */
+SimResult simulate(vector<SimStage> const& stages, SimConfig const& config)
+{
+    size_t K = stages.size();
+    size_t m = max((size_t) 1, config.mini_blocks);
+    size_t n = config.num_items * m;
+    size_t C = config.num_cores;
+
+    if (K == 0)
+    {
+        throw invalid_argument("simulate needs a stage.");
+    }
+
+    // Otherwise no task could ever start, or there would be nothing to time.
+    if (C == 0)
+    {
+        throw invalid_argument("simulate needs a core.");
+    }
+    if (config.num_items == 0)
+    {
+        throw invalid_argument("simulate needs an item.");
+    }
+
+    for (size_t k=0; k<K; k++)
+    {
+        if (stages[k].replicas == 0)
+        {
+            throw invalid_argument("Stage needs a replica: " + stages[k].name);
+        }
+
+        for (size_t j : stages[k].inputs)
+        {
+            if (j >= k)
+            {
+                throw invalid_argument("Stage inputs must have lower index: " + stages[k].name);
+            }
+        }
+    }
+
+    // Stages that are not used as input to any other stage are the outputs.
+    vector<bool> is_sink(K, true);
+    for (auto const& stage : stages)
+    {
+        for (size_t j : stage.inputs)
+        {
+            is_sink[j] = false;
+        }
+    }
+
+    // Pre-sample the processing time for each stage and mini-block, so the
+    // executors can be compared on the same random processing times.
+    mt19937 rng(config.seed);
+    vector<vector<double>> cost(K, vector<double>(n));
+    for (size_t u=0; u<n; u++)
+    {
+        for (size_t k=0; k<K; k++)
+        {
+            cost[k][u] = stages[k].cost(rng) / m + config.overhead;
+        }
+    }
+
+    // Arrival time of each mini-block, which all arrive with their item.
+    auto release = [&](size_t u) { return config.period * (u / m); };
+
+    // Time when each stage finished each mini-block.
+    vector<vector<double>> done(K, vector<double>(n, 0.0));
+
+    SimResult result;
+    double busy = 0;
+
+    if (config.executor == Executor::Serial)
+    {
+        // All stages run one after another in a single thread.
+        double t = 0;
+        for (size_t u=0; u<n; u++)
+        {
+            t = max(t, release(u));
+            for (size_t k=0; k<K; k++)
+            {
+                t += cost[k][u];
+                busy += cost[k][u];
+                done[k][u] = t;
+            }
+        }
+        result.elapsed = t;
+        C = 1;
+    }
+    else if (config.executor == Executor::Lockstep)
+    {
+        // Depth of each stage, which is the number of iterations of delay
+        // from the source, like F_buffer and G_buffer in main2.cpp.
+        vector<size_t> depth(K, 0);
+        size_t max_depth = 0;
+        for (size_t k=0; k<K; k++)
+        {
+            for (size_t j : stages[k].inputs)
+            {
+                depth[k] = max(depth[k], depth[j] + 1);
+            }
+            max_depth = max(max_depth, depth[k]);
+        }
+
+        double t = 0;
+        for (size_t i=0; i<n + max_depth; i++)
+        {
+            // The iteration must wait for the new mini-block to arrive.
+            if (i < n)
+            {
+                t = max(t, release(i));
+            }
+
+            // Processing times for the stages that are not bubbles.
+            vector<double> tasks;
+            for (size_t k=0; k<K; k++)
+            {
+                if (i >= depth[k] && i - depth[k] < n)
+                {
+                    tasks.push_back(cost[k][i - depth[k]]);
+                }
+                else
+                {
+                    result.bubbles++;
+                }
+            }
+
+            // Schedule the tasks on the cores with the longest first, and the
+            // iteration ends when all the threads are joined.
+            sort(tasks.rbegin(), tasks.rend());
+            vector<double> load(C, 0.0);
+            for (double task : tasks)
+            {
+                *min_element(load.begin(), load.end()) += task;
+                busy += task;
+            }
+            double iteration_time = *max_element(load.begin(), load.end());
+
+            t += iteration_time;
+
+            for (size_t k=0; k<K; k++)
+            {
+                if (i >= depth[k] && i - depth[k] < n)
+                {
+                    done[k][i - depth[k]] = t;
+                }
+            }
+        }
+        result.elapsed = t;
+    }
+    else
+    {
+        // Event for a stage finishing a mini-block.
+        struct Event
+        {
+            double time;
+            size_t k;
+            size_t u;
+
+            bool operator>(Event const& other) const
+            {
+                return time > other.time;
+            }
+        };
+
+        priority_queue<Event, vector<Event>, greater<Event>> events;
+
+        // Next mini-block to be started by each stage, which processes them
+        // in order, and its number of busy threads.
+        vector<size_t> next(K, 0);
+        vector<size_t> busy_replicas(K, 0);
+        vector<vector<bool>> finished(K, vector<bool>(n, false));
+        size_t free_cores = C;
+        double t = 0;
+
+        // Whether stage k can start mini-block u at time t.
+        auto can_start = [&](size_t k, size_t u)
+        {
+            if (u >= n || release(u) > t)
+            {
+                return false;
+            }
+            for (size_t j : stages[k].inputs)
+            {
+                if (!finished[j][u])
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        size_t num_finished = 0;
+        while (num_finished < K * n)
+        {
+            // Start as many ready tasks as possible, oldest mini-blocks first.
+            bool started = true;
+            while (started && free_cores > 0)
+            {
+                started = false;
+                size_t best_k = K;
+                for (size_t k=0; k<K; k++)
+                {
+                    if (busy_replicas[k] < stages[k].replicas && can_start(k, next[k]) &&
+                        (best_k == K || next[k] < next[best_k]))
+                    {
+                        best_k = k;
+                    }
+                }
+
+                if (best_k < K)
+                {
+                    size_t u = next[best_k]++;
+                    busy_replicas[best_k]++;
+                    free_cores--;
+                    busy += cost[best_k][u];
+                    events.push({t + cost[best_k][u], best_k, u});
+                    started = true;
+                }
+            }
+
+            // Advance the clock to the next event, or the next arrival.
+            double t_next = events.empty() ? INFINITY : events.top().time;
+            for (size_t k=0; k<K; k++)
+            {
+                if (next[k] < n && release(next[k]) > t)
+                {
+                    t_next = min(t_next, release(next[k]));
+                }
+            }
+            t = t_next;
+
+            while (!events.empty() && events.top().time <= t)
+            {
+                Event e = events.top();
+                events.pop();
+                finished[e.k][e.u] = true;
+                done[e.k][e.u] = e.time;
+                busy_replicas[e.k]--;
+                free_cores++;
+                num_finished++;
+            }
+        }
+        result.elapsed = t;
+    }
+
+    // Latency of each mini-block from its arrival to the last sink-stage.
+    double sum_latency = 0;
+    for (size_t u=0; u<n; u++)
+    {
+        double end = 0;
+        for (size_t k=0; k<K; k++)
+        {
+            if (is_sink[k])
+            {
+                end = max(end, done[k][u]);
+            }
+        }
+        double latency = end - release(u);
+        sum_latency += latency;
+        result.max_latency = max(result.max_latency, latency);
+    }
+
+    result.mean_latency = sum_latency / n;
+    result.throughput = 1000.0 * config.num_items / result.elapsed;
+    result.utilization = busy / (C * result.elapsed);
+    result.idle_time = C * result.elapsed - busy;
+
+    return result;
+}
+
+/*****************************************************************************/
+
+#endif
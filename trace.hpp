@@ -0,0 +1,351 @@
+/******************************************************************************
+ * Record-and-replay of the measured processing times of the stages in a
+ * Parallel Pipeline, so the scheduling can be tuned offline against traces
+ * of real processing times, instead of the fixed sleep_time in common.hpp.
+ *
+ * A stage is wrapped by the TraceRecorder, which then records the input
+ * size, wall-time and CPU-time of every call. Each stage has its own list of
+ * records, which is only written by the thread that runs the stage in the
+ * current iteration, so there are no locks. The trace is saved to a compact
+ * binary file with a fixed-size record for each call.
+ *
+ * The trace can be replayed either in the simulator from simulator.hpp, or as
+ * a synthetic workload that spins the CPU and sleeps for the recorded times.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <time.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <functional>
+
+#include "common.hpp"
+#include "simulator.hpp"
+
+using namespace std;
+
+/*****************************************************************************/
+
+/**
+ * CPU-time in milli-sec used by the calling thread. This only increases while
+ * the thread is running on a CPU core, and not while it is sleeping or
+ * waiting, so it can be compared to the wall-time.
+ */
+double thread_cpu_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/** Size of a string payload in bytes. Other payloads may overload this. */
+size_t payload_size(string const& x)
+{
+    return x.size();
+}
+
+/*****************************************************************************/
+
+/** Record of a single call of a processing stage. */
+struct TraceRecord
+{
+    // Index of the call for this stage.
+    uint32_t call;
+
+    // Size of the input payload.
+    uint32_t input_size;
+
+    // Wall-time in milli-sec.
+    float wall_ms;
+
+    // CPU-time in milli-sec.
+    float cpu_ms;
+};
+
+/** Trace of the calls of all the stages in a pipeline. */
+struct Trace
+{
+    // Name of each stage.
+    vector<string> names;
+
+    // Records of the calls for each stage.
+    vector<vector<TraceRecord>> records;
+
+    /**
+     * Wall-times in milli-sec for all the calls of a stage.
+     *
+     * @param k Index of the stage.
+     * @return Vector of wall-times.
+     */
+    vector<double> wall_times(size_t k) const
+    {
+        vector<double> times;
+        for (auto const& r : records[k])
+        {
+            times.push_back(r.wall_ms);
+        }
+        return times;
+    }
+
+    /** Summary of the trace for printing. */
+    string describe() const
+    {
+        string desc;
+        for (size_t k=0; k<names.size(); k++)
+        {
+            double wall = 0;
+            double cpu = 0;
+            for (auto const& r : records[k])
+            {
+                wall += r.wall_ms;
+                cpu += r.cpu_ms;
+            }
+            size_t n = max((size_t) 1, records[k].size());
+            desc += names[k] + ": " + to_string(records[k].size()) + " calls" +
+                    ", mean wall " + to_string(wall / n) + "ms" +
+                    ", mean CPU " + to_string(cpu / n) + "ms\n";
+        }
+        return desc;
+    }
+};
+
+/*****************************************************************************/
+
+// Magic number and version at the start of a trace file.
+static uint32_t const trace_magic = 0x52545050;  // "PPTR"
+static uint32_t const trace_version = 1;
+
+/**
+ * Save a trace to a binary file.
+ *
+ * @param trace Trace to be saved.
+ * @param path Path of the file.
+ */
+void save_trace(Trace const& trace, string const& path)
+{
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error("Cannot write trace file: " + path);
+    }
+
+    auto write_u32 = [&](uint32_t v) { file.write((char const*) &v, sizeof(v)); };
+
+    write_u32(trace_magic);
+    write_u32(trace_version);
+    write_u32(trace.names.size());
+
+    for (size_t k=0; k<trace.names.size(); k++)
+    {
+        write_u32(trace.names[k].size());
+        file.write(trace.names[k].data(), trace.names[k].size());
+        write_u32(trace.records[k].size());
+        file.write((char const*) trace.records[k].data(),
+                   trace.records[k].size() * sizeof(TraceRecord));
+    }
+}
+
+/**
+ * Load a trace from a binary file.
+ *
+ * @param path Path of the file.
+ * @return Trace.
+ */
+Trace load_trace(string const& path)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error("Cannot read trace file: " + path);
+    }
+
+    // Size of the file, so the sizes in the file can be checked before
+    // anything is allocated, in case the file is truncated or corrupt.
+    file.seekg(0, ios::end);
+    uint64_t file_size = file.tellg();
+    file.seekg(0, ios::beg);
+
+    auto check_size = [&](uint64_t num_bytes)
+    {
+        if (!file || num_bytes > file_size - (uint64_t) file.tellg())
+        {
+            throw runtime_error("Trace file is truncated or corrupt: " + path);
+        }
+    };
+
+    auto read_u32 = [&]()
+    {
+        check_size(sizeof(uint32_t));
+        uint32_t v = 0;
+        file.read((char*) &v, sizeof(v));
+        return v;
+    };
+
+    if (read_u32() != trace_magic || read_u32() != trace_version)
+    {
+        throw runtime_error("Not a trace file: " + path);
+    }
+
+    Trace trace;
+    uint32_t num_stages = read_u32();
+
+    for (uint32_t k=0; k<num_stages; k++)
+    {
+        uint32_t name_size = read_u32();
+        check_size(name_size);
+        string name(name_size, ' ');
+        file.read(&name[0], name.size());
+
+        uint32_t num_records = read_u32();
+        check_size((uint64_t) num_records * sizeof(TraceRecord));
+        vector<TraceRecord> records(num_records);
+        file.read((char*) records.data(), records.size() * sizeof(TraceRecord));
+
+        if (!file)
+        {
+            throw runtime_error("Trace file is truncated or corrupt: " + path);
+        }
+
+        trace.names.push_back(name);
+        trace.records.push_back(records);
+    }
+
+    return trace;
+}
+
+/*****************************************************************************/
+
+/**
+ * Recorder for the processing times of the stages in a pipeline.
+ * The recorder must outlive the wrapped stages.
+ */
+class TraceRecorder
+{
+    private:
+        // Trace with a list of records for each stage.
+        Trace trace;
+
+        // Whether recording is enabled.
+        atomic<bool> enabled{true};
+
+    public:
+        /**
+         * Wrap a processing stage so its calls are recorded. All stages must
+         * be wrapped before the pipeline starts.
+         *
+         * @param name Name of the stage.
+         * @param func Processing function of the stage.
+         * @return Processing function that records its calls.
+         */
+        template <typename T>
+        function<T(T const&)> wrap(string const& name, function<T(T const&)> func)
+        {
+            size_t k = trace.names.size();
+            trace.names.push_back(name);
+            trace.records.emplace_back();
+
+            return [this, k, func](T const& x)
+            {
+                if (!enabled.load(memory_order_relaxed))
+                {
+                    return func(x);
+                }
+
+                auto wall_start = chrono::steady_clock::now();
+                double cpu_start = thread_cpu_ms();
+
+                T y = func(x);
+
+                double cpu_end = thread_cpu_ms();
+                chrono::duration<double, milli> wall = chrono::steady_clock::now() - wall_start;
+
+                // Only the thread running stage k writes to its records.
+                auto& records = trace.records[k];
+                records.push_back({(uint32_t) records.size(), (uint32_t) payload_size(x),
+                                   (float) wall.count(), (float) (cpu_end - cpu_start)});
+
+                return y;
+            };
+        }
+
+        /** Enable or disable the recording. */
+        void enable(bool on)
+        {
+            enabled.store(on);
+        }
+
+        /** Trace recorded so far. Must not be called while the pipeline runs. */
+        Trace const& get() const
+        {
+            return trace;
+        }
+};
+
+/*****************************************************************************/
+
+/**
+ * Distribution of the processing times of a stage for the simulator, which
+ * samples the recorded wall-times.
+ *
+ * @param trace Recorded trace.
+ * @param k Index of the stage.
+ * @return Cost distribution.
+ */
+CostDist replay_cost(Trace const& trace, size_t k)
+{
+    return empirical_cost(trace.wall_times(k));
+}
+
+/**
+ * Synthetic processing stage that replays the recorded processing times of a
+ * stage in order, by spinning the CPU for the recorded CPU-time and sleeping
+ * for the rest of the wall-time. The output is the stage name applied to the
+ * input, like the dummy functions in common.hpp.
+ *
+ * @param trace Recorded trace.
+ * @param k Index of the stage.
+ * @return Processing function.
+ */
+function<string(string const&)> replay_stage(Trace const& trace, size_t k)
+{
+    auto records = make_shared<vector<TraceRecord>>(trace.records[k]);
+    auto call = make_shared<size_t>(0);
+    string name = trace.names[k];
+
+    return [records, call, name](string const& x)
+    {
+        if (!records->empty())
+        {
+            TraceRecord const& r = (*records)[(*call)++ % records->size()];
+
+            // Spin the CPU for the recorded CPU-time.
+            double cpu_end = thread_cpu_ms() + r.cpu_ms;
+            while (thread_cpu_ms() < cpu_end) {}
+
+            // Sleep for the rest of the recorded wall-time.
+            if (r.wall_ms > r.cpu_ms)
+            {
+                this_thread::sleep_for(chrono::duration<double, milli>(r.wall_ms - r.cpu_ms));
+            }
+        }
+
+        return name + "(" + x + ")";
+    };
+}
+
+/*****************************************************************************/
+
+#endif
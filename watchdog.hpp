@@ -0,0 +1,322 @@
+/******************************************************************************
+ * Watchdog that detects and reports stages of a Parallel Pipeline which are
+ * stuck, instead of the whole pipeline freezing silently.
+ *
+ * In main1.cpp to main4.cpp, all the stage threads are joined with
+ * future.get() after each iteration, so if a single stage hangs, the whole
+ * pipeline waits forever without any sign of what went wrong.
+ *
+ * Here the stages are wrapped so each call writes a heartbeat with its start
+ * time and iteration, and a pointer to its input. A background thread checks
+ * the heartbeats at regular intervals, and flags a stage whose current call
+ * has taken more than a multiple of its typical processing time. Only then
+ * is the input described as a string, so the calls do not copy their input.
+ * The input must therefore stay valid while the call runs, which it does for
+ * the buffers of the pipelines in this project. The report says which
+ * iteration and input the stage is stuck on, and it is passed to a failure
+ * policy, which may e.g. log it, raise an alarm or abort the program.
+ ******************************************************************************
+ * This file is part of: https://github.com/Hvass-Labs/Parallel-Pipelines
+ * Published under the MIT License. See the file LICENSE for details.
+ * Copyright 2022 by Magnus Erik Hvass Pedersen.
+ *****************************************************************************/
+
+#ifndef WATCHDOG_HPP
+#define WATCHDOG_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/*****************************************************************************/
+
+/** Report of a stage that is stuck. */
+struct StallReport
+{
+    // Name of the stage.
+    string stage;
+
+    // Iteration of the pipeline when the call started.
+    uint64_t iteration;
+
+    // Input of the call.
+    string input;
+
+    // Time in milli-sec the call has been running.
+    double elapsed_ms;
+
+    // Typical processing time in milli-sec of the stage.
+    double typical_ms;
+
+    /** Description of the report for printing. */
+    string describe() const
+    {
+        return "Stall: stage " + stage + " in iteration " + to_string(iteration) +
+               " on input " + input + " has run for " + to_string(elapsed_ms) +
+               "ms, typical " + to_string(typical_ms) + "ms";
+    }
+};
+
+/**
+ * Description of an input item in a stall report. Other payloads may
+ * overload this, like is_no_data() in common.hpp.
+ */
+string describe_input(string const& x)
+{
+    return x;
+}
+
+/** Failure policy which is called for each stall, by the watchdog thread. */
+using StallPolicy = function<void(StallReport const&)>;
+
+/** Failure policy which prints the report to stderr. */
+void print_stall(StallReport const& report)
+{
+    cerr << report.describe() << endl;
+}
+
+/*****************************************************************************/
+
+/** Watchdog for the stages of a pipeline. */
+class Watchdog
+{
+    private:
+        // Type used for time.
+        using clock_type = chrono::steady_clock;
+
+        // Heartbeat of a single stage.
+        struct Heartbeat
+        {
+            // Name of the stage.
+            string name;
+
+            // Start time in nano-sec of the current call, or 0 if idle.
+            atomic<int64_t> start_ns{0};
+
+            // Iteration when the current call started.
+            atomic<uint64_t> iteration{0};
+
+            // Typical processing time in milli-sec, as a moving average.
+            atomic<double> typical_ms{0.0};
+
+            // Number of calls.
+            atomic<uint64_t> calls{0};
+
+            // Whether the current call has already been reported.
+            atomic<bool> reported{false};
+
+            // Input of the current call, or nullptr if idle, and a function
+            // that describes it. The input is only copied when a stall is
+            // reported. The lock keeps the input alive while it is copied,
+            // and is only contended when the watchdog reports a stall.
+            mutex input_mutex;
+            void const* input = nullptr;
+            function<string(void const*)> describe;
+        };
+
+        // Heartbeats of the stages. These are pointers so they never move.
+        vector<unique_ptr<Heartbeat>> heartbeats;
+
+        // Current iteration of the pipeline.
+        atomic<uint64_t> current_iteration{0};
+
+        // A call is stuck if it takes longer than this multiple of the typical time.
+        double multiple;
+
+        // Number of calls needed before the typical time is trusted.
+        uint64_t min_calls;
+
+        // Time between the checks.
+        chrono::milliseconds interval;
+
+        // Failure policy.
+        StallPolicy policy;
+
+        // Number of stalls detected.
+        atomic<long> num_stalls{0};
+
+        // Whether the watchdog thread should stop.
+        bool stop = false;
+        mutex stop_mutex;
+        condition_variable stop_cv;
+
+        // Watchdog thread, which is started by start().
+        thread checker;
+
+        /** Current time in nano-sec, which is never 0. */
+        static int64_t now_ns()
+        {
+            return chrono::duration_cast<chrono::nanoseconds>(
+                clock_type::now().time_since_epoch()).count() | 1;
+        }
+
+        /** Check the heartbeats of all the stages. */
+        void check()
+        {
+            int64_t now = now_ns();
+
+            for (auto& hb : heartbeats)
+            {
+                int64_t start = hb->start_ns.load();
+                double typical = hb->typical_ms.load();
+
+                if (start == 0 || hb->calls.load() < min_calls || hb->reported.load())
+                {
+                    continue;
+                }
+
+                double elapsed = (now - start) * 1e-6;
+                if (elapsed > multiple * typical)
+                {
+                    StallReport report;
+                    report.stage = hb->name;
+                    report.iteration = hb->iteration.load();
+                    report.elapsed_ms = elapsed;
+                    report.typical_ms = typical;
+
+                    // The call may have finished since its heartbeat was read.
+                    {
+                        lock_guard<mutex> lock(hb->input_mutex);
+                        if (hb->input == nullptr || hb->start_ns.load() != start ||
+                            hb->reported.exchange(true))
+                        {
+                            continue;
+                        }
+                        report.input = hb->describe(hb->input);
+                    }
+
+                    num_stalls++;
+                    policy(report);
+                }
+            }
+        }
+
+        /** Main loop for the watchdog thread. */
+        void run_checker()
+        {
+            unique_lock<mutex> lock(stop_mutex);
+            while (!stop_cv.wait_for(lock, interval, [this] { return stop; }))
+            {
+                lock.unlock();
+                check();
+                lock.lock();
+            }
+        }
+
+    public:
+        /**
+         * Create the watchdog. It must outlive the wrapped stages.
+         *
+         * @param multiple A call is stuck if it takes longer than this
+         *                 multiple of the typical time of the stage.
+         * @param interval Time between the checks.
+         * @param policy Failure policy called for each stall.
+         * @param min_calls Number of calls needed before checking a stage.
+         */
+        Watchdog(double multiple = 5.0, chrono::milliseconds interval = 50ms,
+                 StallPolicy policy = print_stall, uint64_t min_calls = 3)
+            : multiple(multiple), min_calls(min_calls), interval(interval), policy(policy) {}
+
+        Watchdog(Watchdog const&) = delete;
+        Watchdog& operator=(Watchdog const&) = delete;
+
+        /** Stop the watchdog thread. */
+        ~Watchdog()
+        {
+            {
+                lock_guard<mutex> lock(stop_mutex);
+                stop = true;
+            }
+            stop_cv.notify_all();
+
+            if (checker.joinable())
+            {
+                checker.join();
+            }
+        }
+
+        /**
+         * Wrap a processing stage so its calls write heartbeats. All stages
+         * must be wrapped before start() is called.
+         *
+         * @param name Name of the stage.
+         * @param func Processing function of the stage.
+         * @return Processing function that writes heartbeats.
+         */
+        template <typename T>
+        function<T(T const&)> wrap(string const& name, function<T(T const&)> func)
+        {
+            heartbeats.emplace_back(new Heartbeat());
+            Heartbeat* hb = heartbeats.back().get();
+            hb->name = name;
+            hb->describe = [](void const* x) { return describe_input(*(T const*) x); };
+
+            return [this, hb, func](T const& x)
+            {
+                hb->iteration.store(current_iteration.load());
+                hb->reported.store(false);
+                int64_t start = now_ns();
+                {
+                    lock_guard<mutex> lock(hb->input_mutex);
+                    hb->input = &x;
+                    hb->start_ns.store(start);
+                }
+
+                T y = func(x);
+
+                {
+                    lock_guard<mutex> lock(hb->input_mutex);
+                    hb->input = nullptr;
+                    hb->start_ns.store(0);
+                }
+
+                // A stalled call is left out of the moving average, so a
+                // stall does not raise the threshold for the next stall.
+                if (hb->reported.load())
+                {
+                    return y;
+                }
+
+                // Only this stage's thread writes the moving average.
+                double dur = (now_ns() - start) * 1e-6;
+                uint64_t calls = hb->calls.load();
+                double typical = hb->typical_ms.load();
+                hb->typical_ms.store((calls == 0) ? dur : 0.9 * typical + 0.1 * dur);
+                hb->calls.store(calls + 1);
+
+                return y;
+            };
+        }
+
+        /** Start the watchdog thread. */
+        void start()
+        {
+            checker = thread(&Watchdog::run_checker, this);
+        }
+
+        /** Set the current iteration of the pipeline, before its stages are started. */
+        void set_iteration(uint64_t i)
+        {
+            current_iteration.store(i);
+        }
+
+        /** Number of stalls detected. */
+        long stalls() const
+        {
+            return num_stalls.load();
+        }
+};
+
+/*****************************************************************************/
+
+#endif